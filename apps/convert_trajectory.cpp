@@ -0,0 +1,115 @@
+#include "3d-soft-trunk/InverseKinematics.h"
+
+#include <sstream>
+
+/**
+ * @file convert_trajectory.cpp
+ * @brief convert a task space trajectory to a configuration space trajectory with inverse kinematics, e.g. to replay it with PID, LQR or Dyn.
+ *
+ * Usage:
+ * ```bash
+ * ./bin/convert_trajectory softtrunkparams_example.yaml targets.csv q.csv [--threads 8] [--max-curvature 12]
+ * ```
+ * targets.csv has the columns x, y, z, and optionally dx, dy, dz for the direction of the tip axis. A time or timestamp column is copied to the output.
+ * q.csv has the columns [time,] q_0 .. q_n and the residual tip error in m.
+ * The parameter file is read from the config folder, the csv files are paths.
+ */
+int main(int argc, char *argv[]){
+    std::vector<std::string> args;
+    int threads = std::thread::hardware_concurrency();
+    double max_curvature = -1;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--threads" && i+1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--max-curvature" && i+1 < argc)
+            max_curvature = std::atof(argv[++i]);
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 3){
+        fmt::print("usage: {} config.yaml targets.csv output.csv [--threads n] [--max-curvature k]\n", argv[0]);
+        return 1;
+    }
+
+    SoftTrunkParameters st_params{};
+    st_params.load_yaml(args[0]);
+    st_params.finalize();
+
+    std::ifstream file(args[1]);
+    if (!file.is_open()){
+        fmt::print("could not open {}\n", args[1]);
+        return 1;
+    }
+
+    // find the columns by name
+    std::string line;
+    std::getline(file, line);
+    std::vector<std::string> header;
+    std::stringstream ss(line);
+    std::string column;
+    while (std::getline(ss, column, ',')){
+        column.erase(0, column.find_first_not_of(" "));
+        column.erase(column.find_last_not_of(" \r") + 1);
+        header.push_back(column);
+    }
+    auto find = [&](const std::string& name){
+        return (int) (std::find(header.begin(), header.end(), name) - header.begin());
+    };
+    const int x_cols[3] = {find("x"), find("y"), find("z")};
+    const int d_cols[3] = {find("dx"), find("dy"), find("dz")};
+    int t_col = find("time");
+    if (t_col == header.size())
+        t_col = find("timestamp");
+    for (int c : x_cols)
+        if (c == header.size()) { fmt::print("{} does not contain x, y, z\n", args[1]); return 1; }
+    const bool directions = d_cols[0] < header.size() && d_cols[1] < header.size() && d_cols[2] < header.size();
+
+    std::vector<double> t;
+    std::vector<Vector3d> x;
+    std::vector<Vector3d> d;
+    std::vector<double> row(header.size());
+    while (std::getline(file, line)){
+        std::stringstream ls(line);
+        int i = 0;
+        while (i < row.size() && std::getline(ls, column, ','))
+            row[i++] = std::atof(column.c_str());
+        if (i < row.size())
+            continue; // incomplete line
+        if (t_col < header.size())
+            t.push_back(row[t_col]);
+        x.push_back(Vector3d(row[x_cols[0]], row[x_cols[1]], row[x_cols[2]]));
+        if (directions)
+            d.push_back(Vector3d(row[d_cols[0]], row[d_cols[1]], row[d_cols[2]]));
+    }
+
+    InverseKinematics ik{st_params};
+    if (max_curvature > 0)
+        ik.max_curvature_ = max_curvature;
+    std::vector<VectorXd> q;
+    auto start = std::chrono::steady_clock::now();
+    int failed = ik.solve_batch(x, st_params.getBlankState().q, q, threads, d);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fmt::print("solved {} targets in {:.3f}s on {} threads, {} did not converge\n", x.size(), elapsed, threads, failed);
+
+    // residual tip errors
+    PCCKinematics kinematics{st_params};
+    kinematics.set_points({kinematics.segment_end(st_params.num_segments-1)});
+
+    std::ofstream out(args[2]);
+    if (!t.empty())
+        out << header[t_col] << ", ";
+    for (int i = 0; i < st_params.q_size; i++)
+        out << fmt::format("q_{}, ", i);
+    out << "error\n";
+    for (int k = 0; k < x.size(); k++){
+        kinematics.update(q[k], false);
+        if (!t.empty())
+            out << fmt::format("{}, ", t[k]);
+        for (int i = 0; i < st_params.q_size; i++)
+            out << fmt::format("{}, ", q[k](i));
+        out << fmt::format("{}\n", (kinematics.position(0) - x[k]).norm());
+    }
+    fmt::print("wrote {}\n", args[2]);
+    return 0;
+}
@@ -45,7 +45,11 @@ void gain(OSC& osc){ //change parameters online with keyboard to avoid recompili
                 break;
 
             case 'b':
-                osc.loadAttached_ = 0.2;
+                osc.force_compensation_ = !osc.force_compensation_;
+                fmt::print("Force compensation: {}, estimated tip force {}\n", osc.force_compensation_, osc.tip_force().transpose());
+                break;
+            case 'n':
+                osc.tare_tip_force();
                 break;
             case 'f': 
                 osc.freeze = !osc.freeze;
@@ -78,7 +82,6 @@ int main(){
     st_params.finalize();
     OSC osc(st_params);
     VectorXd p;
-    srl::State state = st_params.getBlankState();
 
     Vector3d x_ref_center;
     
@@ -93,7 +96,6 @@ int main(){
 
     double coef = 2 * 3.1415 / 8;
     osc.gripperAttached_ = true;
-    osc.loadAttached_ = 0;
 
     getchar();
     osc.set_ref(x_ref, dx_ref, ddx_ref);
@@ -0,0 +1,51 @@
+#include "3d-soft-trunk/DatasetGenerator.h"
+
+/**
+ * @file generate_dataset.cpp
+ * @brief evaluate the model on many states and pressures, and write them as a dataset to train learned dynamics models. See DatasetGenerator for the format.
+ *
+ * Usage:
+ * ```bash
+ * ./bin/generate_dataset softtrunkparams_example.yaml output_dir [--samples 1000000] [--threads 8] [--seed 0] [--float] [--log log.csv ...]
+ * ```
+ * the parameter file is read from the config folder. With --log, the states and pressures of the logs are used instead of random samples, and --samples is ignored.
+ */
+int main(int argc, char *argv[]){
+    std::vector<std::string> args;
+    std::vector<std::string> logs;
+    long long int samples = 1000000;
+    int threads = std::thread::hardware_concurrency();
+    unsigned int seed = 0;
+    bool single_precision = false;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--samples" && i+1 < argc)
+            samples = std::atoll(argv[++i]);
+        else if (arg == "--threads" && i+1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--seed" && i+1 < argc)
+            seed = std::atoi(argv[++i]);
+        else if (arg == "--float")
+            single_precision = true;
+        else if (arg == "--log" && i+1 < argc)
+            logs.push_back(argv[++i]);
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2 || samples < 1){
+        fmt::print("usage: {} config.yaml output_dir [--samples n] [--threads n] [--seed n] [--float] [--log log.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    SoftTrunkParameters st_params{};
+    st_params.load_yaml(args[0]);
+    st_params.finalize();
+
+    DatasetGenerator gen{st_params, threads};
+    gen.seed_ = seed;
+    gen.single_precision_ = single_precision;
+    for (const auto& log : logs)
+        gen.load_log(log);
+    gen.generate(args[1], samples);
+    return 0;
+}
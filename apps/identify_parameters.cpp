@@ -0,0 +1,42 @@
+#include "3d-soft-trunk/Identification.h"
+
+/**
+ * @file identify_parameters.cpp
+ * @brief fit shear modulus, drag coefficients and chamber configurations to logs recorded with ControllerPCC::toggle_log(), and write them to a new parameter file.
+ *
+ * Usage:
+ * ```bash
+ * ./bin/identify_parameters softtrunkparams_example.yaml identified.yaml log1.csv [log2.csv ...] [--folds 5] [--threads 8]
+ * ```
+ * parameter files are read from and written to the config folder, the logs are paths.
+ */
+int main(int argc, char *argv[]){
+    std::vector<std::string> args;
+    int folds = 5;
+    int threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--folds" && i+1 < argc)
+            folds = std::atoi(argv[++i]);
+        else if (arg == "--threads" && i+1 < argc)
+            threads = std::atoi(argv[++i]);
+        else
+            args.push_back(arg);
+    }
+    if (args.size() < 3 || folds < 2){
+        fmt::print("usage: {} config.yaml output.yaml log.csv [log.csv ...] [--folds 5] [--threads n]\n", argv[0]);
+        return 1;
+    }
+
+    SoftTrunkParameters st_params{};
+    st_params.load_yaml(args[0]);
+    st_params.finalize();
+
+    Identification id{st_params, threads};
+    for (int i = 2; i < args.size(); i++)
+        id.load_log(args[i]);
+    id.identify(folds);
+    id.new_params_.write_yaml(args[1]);
+    fmt::print("wrote identified parameters to config/{}\n", args[1]);
+    return 0;
+}
@@ -0,0 +1,604 @@
+#include "3d-soft-trunk/ControllerPCC.h"
+#include "3d-soft-trunk/PCCKinematics.h"
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <sstream>
+
+/**
+ * @file loopback_rig.cpp
+ * @brief Stand-in for the lab hardware, so that the real I/O path (ValveController + MotionCapture) can be run and benchmarked on any Linux machine.
+ * @details Serves on the local machine
+ * - a Modbus TCP server in place of the valve controller. Register n holds the pressure of valve n in mbar.
+ * - a QTM real-time protocol server in place of Qualisys, streaming 6D frames of the arm segments (and static objects).
+ *
+ * The arm is simulated with ControllerPCC::simulate(), using the pressures received over Modbus, so the streamed frames reflect the commanded pressures.
+ * Received valve commands and sent frames are each delayed by a configurable latency plus uniformly distributed jitter.
+ *
+ * To run the stack against it, set `valve address: 127.0.0.1` in the YAML file (see config/loopback.yaml) and point the QualisysClient to 127.0.0.1.
+ *
+ * Usage:
+ * ```bash
+ * ./bin/loopback_rig loopback.yaml --latency 2 --jitter 1
+ * ```
+ * options: --latency [ms] --jitter [ms] --rate [hz] (simulation & frame rate) --modbus-port [502] --qtm-port [22222]
+ * Port 502 is privileged, run with sudo or give the binary CAP_NET_BIND_SERVICE. Stop it with Ctrl+C, which disconnects the clients and joins all threads.
+ */
+
+/** @brief queue which releases items after a fixed latency plus random jitter. Items keep their order. */
+template <typename T>
+class DelayLine{
+public:
+    DelayLine(double latency, double jitter) : latency_(latency), jitter_(jitter), distribution_(0., 1.) {}
+
+    void push(const T& item){
+        std::lock_guard<std::mutex> lock(mtx);
+        unsigned long long int release = srl::monotonic_us() + (unsigned long long int) (1.0e6*(latency_ + jitter_*distribution_(generator_)));
+        release = std::max(release, last_release_);
+        last_release_ = release;
+        queue_.emplace_back(release, item);
+        cv.notify_one();
+    }
+
+    /** @brief get the next item if it is due, without blocking */
+    bool pop_due(T& item){
+        std::lock_guard<std::mutex> lock(mtx);
+        if (queue_.empty() || queue_.front().first > srl::monotonic_us())
+            return false;
+        item = queue_.front().second;
+        queue_.pop_front();
+        return true;
+    }
+
+    /** @brief block until the next item is due, or until timeout (in us) passes */
+    bool wait_pop(T& item, unsigned long long int timeout){
+        std::unique_lock<std::mutex> lock(mtx);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout);
+        while (true){
+            if (!queue_.empty()){
+                unsigned long long int now = srl::monotonic_us();
+                if (queue_.front().first <= now){
+                    item = queue_.front().second;
+                    queue_.pop_front();
+                    return true;
+                }
+                auto due = std::chrono::steady_clock::now() + std::chrono::microseconds(queue_.front().first - now);
+                if (cv.wait_until(lock, std::min(due, deadline)) == std::cv_status::timeout && deadline <= std::chrono::steady_clock::now())
+                    return false;
+            }
+            else if (cv.wait_until(lock, deadline) == std::cv_status::timeout)
+                return false;
+        }
+    }
+
+private:
+    const double latency_;
+    const double jitter_;
+    std::mt19937 generator_{std::random_device{}()};
+    std::uniform_real_distribution<double> distribution_;
+    unsigned long long int last_release_ = 0;
+    std::deque<std::pair<unsigned long long int, T>> queue_;
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+/** @brief valve registers written by one Modbus request */
+struct ValveCommand{
+    std::vector<std::pair<int, int>> registers;
+    /** @brief time the request was received, in us */
+    unsigned long long int received;
+};
+
+/** @brief one 6D frame, ready to be sent */
+struct Frame{
+    std::string packet;
+    /** @brief receive time of the oldest valve command this frame is the first to reflect, 0 if none */
+    unsigned long long int command_received = 0;
+};
+
+struct QtmClient{
+    int fd;
+    sockaddr_in address;
+    std::mutex mtx;
+    bool streaming = false;
+    /** @brief 0 if the frames are streamed over TCP */
+    int udp_port = 0;
+    /** @brief only every divisor-th frame is sent */
+    int divisor = 1;
+    int counter = 0;
+};
+
+std::atomic<bool> run{true};
+
+void stop(int){
+    run = false;
+}
+
+/** @brief sockets of the connected clients, so that they can be shut down on exit */
+std::vector<int> client_fds;
+std::mutex client_fds_mtx;
+
+void close_client(int fd){
+    std::lock_guard<std::mutex> lock(client_fds_mtx);
+    client_fds.erase(std::find(client_fds.begin(), client_fds.end(), fd));
+    close(fd);
+}
+
+// statistics, reset every second by the main thread
+std::atomic<unsigned long int> modbus_requests{0};
+std::atomic<unsigned long int> frames_sent{0};
+std::atomic<unsigned long int> command_frames{0};
+std::atomic<unsigned long long int> command_to_frame_us{0};
+std::atomic<unsigned long long int> command_to_frame_max_us{0};
+
+/** @brief read exactly n bytes from a socket, false on disconnect */
+bool read_all(int fd, char* buffer, size_t n){
+    while (n > 0){
+        ssize_t r = recv(fd, buffer, n, 0);
+        if (r <= 0)
+            return false;
+        buffer += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool send_all(int fd, const std::string& data){
+    size_t sent = 0;
+    while (sent < data.size()){
+        ssize_t r = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (r <= 0)
+            return false;
+        sent += r;
+    }
+    return true;
+}
+
+int listen_on(int port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (sockaddr*) &address, sizeof(address)) < 0 || listen(fd, 8) < 0){
+        fmt::print("could not listen on port {}: {}\n", port, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+/** @brief accept connections until run is false, handling each client on its own thread
+ * @details on exit, the server socket is shut down to wake up accept(), and the handlers stop once their client socket is shut down */
+void accept_loop(int server_fd, std::function<void(int, sockaddr_in)> handler){
+    std::vector<std::thread> threads;
+    while (run){
+        sockaddr_in address{};
+        socklen_t len = sizeof(address);
+        int fd = accept(server_fd, (sockaddr*) &address, &len);
+        if (fd < 0)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(client_fds_mtx);
+            if (!run){ // accepted while shutting down, after the clients were shut down
+                close(fd);
+                break;
+            }
+            client_fds.push_back(fd);
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        threads.emplace_back(handler, fd, address);
+    }
+    for (auto& t : threads)
+        t.join();
+}
+
+// ------------------------------------------ Modbus TCP ------------------------------------------
+
+uint16_t get16(const char* b){
+    return ((uint8_t) b[0] << 8) | (uint8_t) b[1];
+}
+
+void put16(std::string& s, uint16_t v){
+    s.push_back(v >> 8);
+    s.push_back(v & 0xff);
+}
+
+std::vector<uint16_t> registers(64, 0);
+std::mutex registers_mtx;
+
+/** @brief serve one Modbus TCP client. Supports write multiple registers (0x10), write single register (0x06) and reading them back (0x03, 0x04) */
+void modbus_client(int fd, sockaddr_in address, DelayLine<ValveCommand>* valve_line){
+    fmt::print("Modbus client connected from {}\n", inet_ntoa(address.sin_addr));
+    char header[7];
+    std::vector<char> pdu;
+    while (run && read_all(fd, header, 7)){
+        ValveCommand command;
+        command.received = srl::monotonic_us();
+        int length = get16(header + 4) - 1; // length field includes the unit id
+        if (length < 1 || length > 253)
+            break;
+        pdu.resize(length);
+        if (!read_all(fd, pdu.data(), length))
+            break;
+
+        std::string response(header, 7);
+        uint8_t function = pdu[0];
+        response.push_back(function);
+        int address0 = length >= 3 ? get16(&pdu[1]) : 0;
+        int quantity = length >= 5 ? get16(&pdu[3]) : 0;
+        switch (function){
+            case 0x10: // write multiple registers
+                if (length < 6 || address0 + quantity > registers.size() || length < 6 + 2*quantity){
+                    response.back() |= 0x80; response.push_back(0x02);
+                    break;
+                }
+                for (int i = 0; i < quantity; i++)
+                    command.registers.emplace_back(address0 + i, get16(&pdu[6 + 2*i]));
+                put16(response, address0);
+                put16(response, quantity);
+                break;
+            case 0x06: // write single register
+                if (length < 5 || address0 >= registers.size()){
+                    response.back() |= 0x80; response.push_back(0x02);
+                    break;
+                }
+                command.registers.emplace_back(address0, quantity);
+                put16(response, address0);
+                put16(response, quantity);
+                break;
+            case 0x03: // read holding registers
+            case 0x04: // read input registers
+            {
+                if (length < 5 || address0 + quantity > registers.size()){
+                    response.back() |= 0x80; response.push_back(0x02);
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(registers_mtx);
+                response.push_back(2*quantity);
+                for (int i = 0; i < quantity; i++)
+                    put16(response, registers[address0 + i]);
+                break;
+            }
+            default:
+                response.back() |= 0x80;
+                response.push_back(0x01); // illegal function
+        }
+        if (!command.registers.empty()){
+            std::lock_guard<std::mutex> lock(registers_mtx);
+            for (auto& r : command.registers)
+                registers[r.first] = r.second;
+            valve_line->push(command);
+        }
+        uint16_t response_length = response.size() - 6;
+        response[4] = response_length >> 8;
+        response[5] = response_length & 0xff;
+        modbus_requests++;
+        if (!send_all(fd, response))
+            break;
+    }
+    close_client(fd);
+    fmt::print("Modbus client disconnected\n");
+}
+
+// ------------------------------------------ QTM RT protocol ------------------------------------------
+
+enum QtmPacket : uint32_t {qtm_error = 0, qtm_command = 1, qtm_xml = 2, qtm_data = 3, qtm_no_more_data = 4};
+
+/** @brief packets are sent little endian (the protocol default since version 1.2), so the host byte order is used as is */
+std::string qtm_packet(uint32_t type, const std::string& payload){
+    std::string packet(8, '\0');
+    uint32_t size = 8 + payload.size();
+    memcpy(&packet[0], &size, 4);
+    memcpy(&packet[4], &type, 4);
+    return packet + payload;
+}
+
+std::string qtm_string(uint32_t type, const std::string& s){
+    return qtm_packet(type, s + '\0');
+}
+
+template <typename T>
+void append(std::string& s, T v){
+    s.append((const char*) &v, sizeof(T));
+}
+
+std::vector<std::shared_ptr<QtmClient>> qtm_clients;
+std::mutex qtm_clients_mtx;
+std::string latest_frame;
+std::mutex latest_frame_mtx;
+
+/** @brief serve one QTM client. Supports the commands needed to stream 6D data: Version, QTMVersion, ByteOrder, GetParameters, GetCurrentFrame, StreamFrames */
+void qtm_client(int fd, sockaddr_in address, int num_bodies, double rate){
+    fmt::print("QTM client connected from {}\n", inet_ntoa(address.sin_addr));
+    auto client = std::make_shared<QtmClient>();
+    client->fd = fd;
+    client->address = address;
+    {
+        std::lock_guard<std::mutex> lock(qtm_clients_mtx);
+        qtm_clients.push_back(client);
+    }
+    auto reply = [&](uint32_t type, const std::string& s){
+        std::lock_guard<std::mutex> lock(client->mtx);
+        return send_all(fd, qtm_string(type, s));
+    };
+    reply(qtm_command, "QTM RT Interface connected");
+
+    char header[8];
+    std::string payload;
+    while (run && read_all(fd, header, 8)){
+        uint32_t size, type;
+        memcpy(&size, header, 4);
+        memcpy(&type, header + 4, 4);
+        if (size < 8 || size > 65536)
+            break;
+        payload.resize(size - 8);
+        if (!read_all(fd, &payload[0], size - 8))
+            break;
+        if (type != qtm_command)
+            continue;
+        std::string cmd = payload.substr(0, payload.find('\0'));
+        std::istringstream tokens(cmd);
+        std::string name;
+        tokens >> name;
+
+        if (name == "Version"){
+            std::string version;
+            tokens >> version;
+            reply(qtm_command, version.empty() ? "Version is 1.19" : "Version set to " + version);
+        }
+        else if (name == "QTMVersion")
+            reply(qtm_command, "QTM Version is 2.17 (loopback stand-in)");
+        else if (name == "ByteOrder")
+            reply(qtm_command, "Byte order is little endian");
+        else if (name == "GetParameters"){
+            std::string xml = "<QTM_Parameters_Ver_1.19><The_6D>";
+            xml += fmt::format("<Bodies>{}</Bodies>", num_bodies);
+            for (int i = 0; i < num_bodies; i++)
+                xml += fmt::format("<Body><Name>{}</Name><RGBColor>16711680</RGBColor><Points></Points></Body>", i);
+            xml += "</The_6D></QTM_Parameters_Ver_1.19>";
+            reply(qtm_xml, xml);
+        }
+        else if (name == "GetCurrentFrame"){
+            std::string frame;
+            {
+                std::lock_guard<std::mutex> lock(latest_frame_mtx);
+                frame = latest_frame;
+            }
+            std::lock_guard<std::mutex> lock(client->mtx);
+            send_all(fd, frame.empty() ? qtm_packet(qtm_no_more_data, "") : frame);
+        }
+        else if (name == "StreamFrames"){
+            std::lock_guard<std::mutex> lock(client->mtx);
+            std::string token;
+            client->streaming = true;
+            client->udp_port = 0;
+            client->divisor = 1;
+            while (tokens >> token){
+                if (token == "Stop")
+                    client->streaming = false;
+                else if (token.rfind("Frequency:", 0) == 0)
+                    client->divisor = std::max(1, (int) std::round(rate / std::stod(token.substr(10))));
+                else if (token.rfind("FrequencyDivisor:", 0) == 0)
+                    client->divisor = std::max(1, std::stoi(token.substr(17)));
+                else if (token.rfind("UDP:", 0) == 0)
+                    client->udp_port = std::stoi(token.substr(token.rfind(':') + 1)); // UDP:port or UDP:address:port, always sent to the client's address
+            }
+        }
+        else if (name == "Disconnect")
+            break;
+        else
+            reply(qtm_error, "Command not supported by the loopback stand-in");
+    }
+    {
+        std::lock_guard<std::mutex> lock(qtm_clients_mtx);
+        qtm_clients.erase(std::find(qtm_clients.begin(), qtm_clients.end(), client));
+    }
+    close_client(fd);
+    fmt::print("QTM client disconnected\n");
+}
+
+/** @brief send the frames to all streaming clients once they are due */
+void frame_sender_loop(DelayLine<Frame>* frame_line){
+    int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    Frame frame;
+    while (run){
+        if (!frame_line->wait_pop(frame, 100000))
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(latest_frame_mtx);
+            latest_frame = frame.packet;
+        }
+        std::lock_guard<std::mutex> lock(qtm_clients_mtx);
+        for (auto& client : qtm_clients){
+            std::lock_guard<std::mutex> client_lock(client->mtx);
+            if (!client->streaming || (client->counter++ % client->divisor) != 0)
+                continue;
+            if (client->udp_port == 0)
+                send_all(client->fd, frame.packet);
+            else {
+                sockaddr_in address = client->address;
+                address.sin_port = htons(client->udp_port);
+                sendto(udp_fd, frame.packet.data(), frame.packet.size(), 0, (sockaddr*) &address, sizeof(address));
+            }
+        }
+        frames_sent++;
+        if (frame.command_received != 0){
+            unsigned long long int delay = srl::monotonic_us() - frame.command_received;
+            command_frames++;
+            command_to_frame_us += delay;
+            if (delay > command_to_frame_max_us)
+                command_to_frame_max_us = delay;
+        }
+    }
+    close(udp_fd);
+}
+
+// ------------------------------------------ kinematics ------------------------------------------
+
+/** @brief arc lengths of the frames streamed for the arm: the prismatic joint (if any) and the tip of each segment */
+std::vector<double> frame_arc_lengths(const SoftTrunkParameters& st_params, const PCCKinematics& kinematics){
+    std::vector<double> arc_lengths;
+    if (st_params.prismatic)
+        arc_lengths.push_back(0);
+    for (int i = 0; i < st_params.num_segments; i++)
+        arc_lengths.push_back(kinematics.segment_end(i));
+    return arc_lengths;
+}
+
+/** @brief transforms of the base, the prismatic joint (if any) and the tip of each segment, in the frame MotionCapture expresses them in */
+void forward_kinematics(const SoftTrunkParameters& st_params, PCCKinematics& kinematics, const VectorXd& q, std::vector<Affine3d>& frames){
+    frames[0] = Affine3d::Identity();
+    frames[0].linear() = Eigen::AngleAxisd(st_params.armAngle*PI/180, Vector3d::UnitY()).toRotationMatrix();
+    kinematics.update(q, false);
+    for (int k = 0; k < kinematics.num_points(); k++)
+        frames[k + 1] = kinematics.pose(k);
+}
+
+/** @brief pack the frames into a QTM data packet with one 6D component, undoing the transformation done in MotionCapture::process_frame */
+std::string qtm_frame(const std::vector<Affine3d>& frames, unsigned long long int timestamp, uint32_t frame_number){
+    Matrix3d rot;
+    rot << 0, 0, -1, 0, 1, 0, 1, 0, 0;
+    Matrix3d rot_trans;
+    rot_trans << -1, 0, 0, 0, 1, 0, 0, 0, -1;
+    const Matrix3d to_qtm = (rot*rot_trans).transpose();
+    const Vector3d origin(0, 0, 1.5); // position of the base in the QTM frame, in m
+
+    std::string data;
+    append<uint64_t>(data, timestamp);
+    append<uint32_t>(data, frame_number);
+    append<uint32_t>(data, 1); // component count
+    append<uint32_t>(data, 16 + 48*frames.size()); // component size
+    append<uint32_t>(data, 5); // component type 6D
+    append<uint32_t>(data, frames.size());
+    append<uint16_t>(data, 0); // 2D drop rate
+    append<uint16_t>(data, 0); // 2D out of sync rate
+    for (auto& frame : frames){
+        Vector3d t = 1000. * (origin + to_qtm * frame.translation()); // QTM sends mm
+        Matrix3d R = frame.linear() * rot.transpose();
+        for (int i = 0; i < 3; i++)
+            append<float>(data, t(i));
+        for (int col = 0; col < 3; col++) // rotation matrix is sent column major
+            for (int row = 0; row < 3; row++)
+                append<float>(data, R(row, col));
+    }
+    return qtm_packet(qtm_data, data);
+}
+
+// ------------------------------------------ main ------------------------------------------
+
+int main(int argc, char *argv[]){
+    SoftTrunkParameters st_params{};
+    double latency = 0.;    // ms
+    double jitter = 0.;     // ms
+    double rate = 500.;     // hz
+    int modbus_port = 502;
+    int qtm_port = 22222;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0 && i + 1 < argc){
+            std::string value = argv[++i];
+            if (arg == "--latency") latency = std::stod(value);
+            else if (arg == "--jitter") jitter = std::stod(value);
+            else if (arg == "--rate") rate = std::stod(value);
+            else if (arg == "--modbus-port") modbus_port = std::stoi(value);
+            else if (arg == "--qtm-port") qtm_port = std::stoi(value);
+            else fmt::print("unknown option {}\n", arg);
+        }
+        else
+            st_params.load_yaml(arg);
+    }
+    st_params.sensors = {SensorType::simulator};
+    st_params.finalize();
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    const int num_bodies = st_params.num_segments + 1 + st_params.prismatic + st_params.objects;
+    fmt::print("loopback rig: {} bodies at {} Hz, latency {} ms, jitter {} ms\n", num_bodies, rate, latency, jitter);
+
+    ControllerPCC sim{st_params};
+    sim.dt_ = 1./rate;
+
+    DelayLine<ValveCommand> valve_line{latency/1000, jitter/1000};
+    DelayLine<Frame> frame_line{latency/1000, jitter/1000};
+
+    int modbus_fd = listen_on(modbus_port);
+    int qtm_fd = listen_on(qtm_port);
+    std::thread modbus_thread(accept_loop, modbus_fd, [&](int fd, sockaddr_in address){ modbus_client(fd, address, &valve_line); });
+    std::thread qtm_thread(accept_loop, qtm_fd, [&](int fd, sockaddr_in address){ qtm_client(fd, address, num_bodies, rate); });
+    std::thread sender_thread(frame_sender_loop, &frame_line);
+
+    // simulation loop, this thread also prints the statistics
+    std::vector<int> valve_pressures(registers.size(), 0);
+    VectorXd p = VectorXd::Zero(st_params.p_size);
+    std::vector<Affine3d> frames(num_bodies, Affine3d::Identity());
+    PCCKinematics kinematics(st_params);
+    kinematics.set_points(frame_arc_lengths(st_params, kinematics));
+    for (int i = 0; i < st_params.objects; i++) // objects are static, placed in front of the arm
+        frames[num_bodies - st_params.objects + i].translation() = Vector3d(0.1 + 0.05*i, 0, -0.2);
+
+    srl::Rate r{rate};
+    uint32_t frame_number = 0;
+    unsigned long long int start = srl::monotonic_us();
+    unsigned long long int last_print = start;
+    while (run){
+        r.sleep();
+        Frame frame;
+        ValveCommand command;
+        while (valve_line.pop_due(command)){
+            for (auto& reg : command.registers)
+                valve_pressures[reg.first] = reg.second;
+            if (frame.command_received == 0)
+                frame.command_received = command.received;
+        }
+        for (int i = 0; i < st_params.p_size; i++)
+            p(i) = std::min(valve_pressures[st_params.valvemap[i]], st_params.p_max);
+
+        if (!sim.simulate(p)){
+            fmt::print("simulation diverged, resetting the arm\n");
+            sim.state_ = st_params.getBlankState();
+        }
+        forward_kinematics(st_params, kinematics, sim.state_.q, frames);
+        frame.packet = qtm_frame(frames, srl::monotonic_us() - start, frame_number++);
+        frame_line.push(frame);
+
+        unsigned long long int now = srl::monotonic_us();
+        if (now - last_print > 1000000){
+            double elapsed = (now - last_print) / 1.0e6;
+            unsigned long int n = command_frames.exchange(0);
+            fmt::print("modbus requests/s: {:.0f}\tframes/s: {:.0f}\tcommand to frame latency: mean {:.2f} ms, max {:.2f} ms\n",
+                modbus_requests.exchange(0)/elapsed, frames_sent.exchange(0)/elapsed,
+                n == 0 ? 0. : command_to_frame_us.exchange(0)/1000./n, command_to_frame_max_us.exchange(0)/1000.);
+            last_print = now;
+        }
+    }
+
+    fmt::print("shutting down\n");
+    shutdown(modbus_fd, SHUT_RDWR); // wakes up accept()
+    shutdown(qtm_fd, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> lock(client_fds_mtx);
+        for (int fd : client_fds)
+            shutdown(fd, SHUT_RDWR); // wakes up the clients blocked in recv()
+    }
+    modbus_thread.join();
+    qtm_thread.join();
+    sender_thread.join();
+    close(modbus_fd);
+    close(qtm_fd);
+    return 0;
+}
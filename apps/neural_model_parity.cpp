@@ -0,0 +1,115 @@
+#include "3d-soft-trunk/Model.h"
+#include <numeric>
+#include <random>
+
+/**
+ * @file neural_model_parity.cpp
+ * @brief compare a NeuralModel with the augmented model it was trained on: errors of B, c, g, J and of the resulting acceleration, and the time of Model::update().
+ *
+ * Usage:
+ * ```bash
+ * ./bin/neural_model_parity softtrunkparams_example.yaml neural_2segment.yaml [--samples 1000] [--seed 1]
+ * ```
+ * the parameter file (with the augmented model) and the weights are read from the config folder.
+ * States and pressures are drawn uniformly from the default ranges of DatasetGenerator. generate_dataset seeds worker i with seed + i directly,
+ * while the generator here is seeded through a std::seed_seq with an additional domain constant, so for any seeds the samples are not a replay of a training shard.
+ * Errors are relative, \f$ \|x_{neural} - x_{augmented}\| / \|x_{augmented}\| \f$, and the report is written as a markdown table.
+ */
+
+/** @brief mean, 95th percentile and max of v as table cells, sorts v
+ * @param times print in us instead of scientific notation */
+std::string summary(std::vector<double>& v, bool times = false){
+    std::sort(v.begin(), v.end());
+    double mean = std::accumulate(v.begin(), v.end(), 0.) / v.size();
+    if (times)
+        return fmt::format("{:.1f} | {:.1f} | {:.1f}", mean, v[(int) (0.95*(v.size()-1))], v.back());
+    return fmt::format("{:.2e} | {:.2e} | {:.2e}", mean, v[(int) (0.95*(v.size()-1))], v.back());
+}
+
+int main(int argc, char *argv[]){
+    std::vector<std::string> args;
+    int samples = 1000;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--samples" && i+1 < argc)
+            samples = std::atoi(argv[++i]);
+        else if (arg == "--seed" && i+1 < argc)
+            seed = std::atoi(argv[++i]);
+        else
+            args.push_back(arg);
+    }
+    if (args.size() != 2 || samples < 1){
+        fmt::print("usage: {} config.yaml weights.yaml [--samples n] [--seed n]\n", argv[0]);
+        return 1;
+    }
+
+    SoftTrunkParameters st_params{};
+    st_params.load_yaml(args[0]);
+    st_params.model_type = ModelType::augmentedrigidarm;
+    SoftTrunkParameters nn_params = st_params;
+    nn_params.model_type = ModelType::neural;
+    nn_params.neural_weights = args[1];
+    st_params.finalize();
+    nn_params.finalize();
+    Model reference{st_params};
+    Model neural{nn_params};
+
+    std::seed_seq seed_sequence{seed, 0x70617269u}; // a separate domain from the integer seeds of DatasetGenerator
+    std::mt19937_64 random(seed_sequence);
+    std::uniform_real_distribution<double> uniform(-1., 1.);
+    srl::State state = st_params.getBlankState();
+    VectorXd p = VectorXd::Zero(st_params.p_size);
+    std::vector<double> err_B, err_c, err_g, err_J, err_ddq, time_reference, time_neural;
+    for (int k = 0; k < samples; k++){
+        for (int i = 0; i < st_params.q_size; i++){
+            state.q(i) = 0.6*uniform(random);
+            state.dq(i) = 2.*uniform(random);
+        }
+        if (st_params.coord_type == CoordType::phitheta){
+            for (int s = 0; s < st_params.num_segments*st_params.sections_per_segment; s++){
+                state.q(2*s + st_params.prismatic) = PI*uniform(random);
+                state.q(2*s + 1 + st_params.prismatic) = std::abs(state.q(2*s + 1 + st_params.prismatic));
+            }
+        }
+        for (int i = 0; i < st_params.p_size; i++)
+            p(i) = st_params.p_max*(uniform(random) + 1)/2;
+
+        auto start = std::chrono::steady_clock::now();
+        reference.update(state, true);
+        auto mid = std::chrono::steady_clock::now();
+        neural.update(state, true);
+        auto end = std::chrono::steady_clock::now();
+        time_reference.push_back(std::chrono::duration<double, std::micro>(mid - start).count());
+        time_neural.push_back(std::chrono::duration<double, std::micro>(end - mid).count());
+
+        const DynamicParams& ref = reference.dyn_;
+        const DynamicParams& nn = neural.dyn_;
+        err_B.push_back((nn.B - ref.B).norm() / ref.B.norm());
+        err_c.push_back((nn.c - ref.c).norm() / std::max(ref.c.norm(), 1e-9));
+        err_g.push_back((nn.g - ref.g).norm() / std::max(ref.g.norm(), 1e-9));
+        double J_diff = 0;
+        double J_norm = 0;
+        for (int s = 0; s < st_params.num_segments; s++){
+            J_diff += (nn.J[s] - ref.J[s]).squaredNorm();
+            J_norm += ref.J[s].squaredNorm();
+        }
+        err_J.push_back(std::sqrt(J_diff / J_norm));
+        // acceleration under pressure p, which is what a simulation or a feedforward term would see
+        VectorXd ddq_ref = ref.B.ldlt().solve(ref.A*100*p - ref.c - ref.g - ref.K*state.q - ref.D*state.dq);
+        VectorXd ddq_nn = nn.B.ldlt().solve(nn.A*100*p - nn.c - nn.g - nn.K*state.q - nn.D*state.dq);
+        err_ddq.push_back((ddq_nn - ddq_ref).norm() / std::max(ddq_ref.norm(), 1e-9));
+    }
+
+    fmt::print("\n## NeuralModel parity, {} ({} segments, {} sections per segment), {} samples\n\n", st_params.robot_name, st_params.num_segments, st_params.sections_per_segment, samples);
+    fmt::print("| relative error | mean | 95th percentile | max |\n|---|---|---|---|\n");
+    fmt::print("| B | {} |\n", summary(err_B));
+    fmt::print("| c | {} |\n", summary(err_c));
+    fmt::print("| g | {} |\n", summary(err_g));
+    fmt::print("| J | {} |\n", summary(err_J));
+    fmt::print("| ddq | {} |\n", summary(err_ddq));
+    fmt::print("\n| Model::update() [us] | mean | 95th percentile | max |\n|---|---|---|---|\n");
+    fmt::print("| augmented | {} |\n", summary(time_reference, true));
+    fmt::print("| neural | {} |\n", summary(time_neural, true));
+    return 0;
+}
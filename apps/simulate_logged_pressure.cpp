@@ -15,7 +15,6 @@ int main(int argc, char *argv[]){
     const double dt = 0.01;
     SoftTrunkParameters st_params{};
     st_params.finalize();
-    srl::State state = st_params.getBlankState();
     ControllerPCC cpcc{st_params};
     VectorXd p = VectorXd::Zero(st_params.p_size);
 
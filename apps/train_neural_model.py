@@ -0,0 +1,113 @@
+import numpy as np
+import yaml
+import sys
+import os
+
+"""
+python3 train_neural_model.py dataset_dir weights.yaml [hidden_layers] [width] [epochs]
+
+Train the network of NeuralModel on a dataset written by generate_dataset, and write its weights file.
+Only numpy and pyyaml are needed. The defaults (2 hidden layers of 64 neurons, 30 epochs) take a few minutes for a million samples.
+Copy the weights file into the config folder, and set "model type: neural" and "neural weights" in the parameter file.
+Check the result against the augmented model with neural_model_parity.
+"""
+
+dataset = sys.argv[1]
+output = sys.argv[2]
+hidden_layers = int(sys.argv[3]) if len(sys.argv) > 3 else 2
+width = int(sys.argv[4]) if len(sys.argv) > 4 else 64
+epochs = int(sys.argv[5]) if len(sys.argv) > 5 else 30
+batch = 256
+learning_rate = 1e-3
+validation = 0.1
+
+manifest = yaml.safe_load(open(os.path.join(dataset, "manifest.yaml")))
+dtype = np.float32 if manifest["dtype"] == "float32" else np.float64
+records = np.concatenate([np.fromfile(os.path.join(dataset, s["file"]), dtype).reshape(-1, manifest["record size"]) for s in manifest["shards"]])
+fields = {f["name"]: (f["offset"], f["shape"]) for f in manifest["fields"]}
+
+def field(name):
+    offset, shape = fields[name]
+    return records[:, offset:offset + int(np.prod(shape))].reshape([-1] + shape).astype(np.float64)
+
+q_size = manifest["q size"]
+q = field("q")
+dq = field("dq")
+B = field("B")
+
+# targets: lower triangle of the cholesky factor of B (log of the diagonal), c, g, J
+L = np.linalg.cholesky(B)
+rows, cols = np.tril_indices(q_size)
+L_flat = L[:, rows, cols]
+diagonal = rows == cols
+L_flat[:, diagonal] = np.log(L_flat[:, diagonal])
+outputs = [("L", L_flat), ("c", field("c")), ("g", field("g")), ("J", field("J").reshape(len(records), -1))]
+
+x = np.concatenate([q, dq], axis=1)
+y = np.concatenate([o[1] for o in outputs], axis=1)
+input_mean = x.mean(axis=0)
+input_scale = 1 / np.maximum(x.std(axis=0), 1e-9)
+output_mean = y.mean(axis=0)
+output_scale = np.maximum(y.std(axis=0), 1e-9)  # constant outputs (e.g. zero entries of J) are reproduced by the mean
+x = (x - input_mean) * input_scale
+y = (y - output_mean) / output_scale
+
+rng = np.random.default_rng(0)
+order = rng.permutation(len(x))
+n_val = int(validation * len(x))
+x_val, y_val = x[order[:n_val]], y[order[:n_val]]
+x_train, y_train = x[order[n_val:]], y[order[n_val:]]
+
+# tanh hidden layers and a linear output layer, as evaluated by NeuralModel
+sizes = [x.shape[1]] + [width] * hidden_layers + [y.shape[1]]
+W = [rng.normal(0, np.sqrt(1 / sizes[i]), (sizes[i + 1], sizes[i])) for i in range(len(sizes) - 1)]
+b = [np.zeros(sizes[i + 1]) for i in range(len(sizes) - 1)]
+
+def forward(x):
+    a = [x]
+    for i in range(len(W)):
+        z = a[-1] @ W[i].T + b[i]
+        a.append(np.tanh(z) if i < len(W) - 1 else z)
+    return a
+
+# adam
+m = [np.zeros_like(p) for p in W + b]
+v = [np.zeros_like(p) for p in W + b]
+step = 0
+for epoch in range(epochs):
+    perm = rng.permutation(len(x_train))
+    for k in range(0, len(perm), batch):
+        idx = perm[k:k + batch]
+        a = forward(x_train[idx])
+        delta = 2 * (a[-1] - y_train[idx]) / (len(idx) * y.shape[1])  # gradient of the mean squared error
+        grads_W, grads_b = [], []
+        for i in reversed(range(len(W))):
+            grads_W.insert(0, delta.T @ a[i])
+            grads_b.insert(0, delta.sum(axis=0))
+            if i > 0:
+                delta = (delta @ W[i]) * (1 - a[i] ** 2)
+        step += 1
+        for j, (p, g) in enumerate(zip(W + b, grads_W + grads_b)):
+            m[j] = 0.9 * m[j] + 0.1 * g
+            v[j] = 0.999 * v[j] + 0.001 * g ** 2
+            p -= learning_rate * (m[j] / (1 - 0.9 ** step)) / (np.sqrt(v[j] / (1 - 0.999 ** step)) + 1e-8)
+    train_loss = np.mean((forward(x_train[:10000])[-1] - y_train[:10000]) ** 2)
+    val_loss = np.mean((forward(x_val)[-1] - y_val) ** 2)
+    print(f"epoch {epoch + 1}/{epochs}: training loss {train_loss:.2e}, validation loss {val_loss:.2e} (normalized)")
+
+weights = {
+    "q size": q_size,
+    "p size": manifest["p size"],
+    "num segments": manifest["num segments"],
+    "input mean": input_mean.tolist(),
+    "input scale": input_scale.tolist(),
+    "layers": [{"rows": w.shape[0], "cols": w.shape[1], "weights": w.flatten().tolist(), "bias": bb.tolist()} for w, bb in zip(W, b)],
+    "outputs": [{"name": name, "size": values.shape[1]} for name, values in outputs],
+    "output mean": output_mean.tolist(),
+    "output scale": output_scale.tolist(),
+}
+for constant in ["K", "D", "A", "A_pseudo"]:
+    weights[constant] = manifest[constant]
+with open(output, "w") as f:
+    yaml.safe_dump(weights, f, default_flow_style=None, sort_keys=False)
+print(f"wrote {output}")
@@ -21,8 +21,7 @@ void osc_target_cb(const trajectory_msgs::JointTrajectoryPoint &msg)
         osc_target(i) = msg.positions[i];
         osc_target_d(i) = msg.velocities[i];
     }
-    if (!is_goal_received)
-        is_goal_received = true;
+    is_goal_received = true;
 }
 
 void control_hand_cb(const std_msgs::Bool &msg){
@@ -67,8 +66,10 @@ int main(int argc, char **argv)
         stm.updateState(state);
         vis.publishState();
         
-        if (is_goal_received)
-            osc.set_ref(osc_target, osc_target_d);
+        if (is_goal_received){ // the sparse targets are smoothed by the trajectory generator of the controller, only the latest one is kept queued
+            osc.add_waypoint(osc_target, 0, true);
+            is_goal_received = false;
+        }
         if (!ros::ok())
             break;
     }
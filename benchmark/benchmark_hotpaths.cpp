@@ -0,0 +1,270 @@
+#include "3d-soft-trunk/ControllerPCC.h"
+#include "3d-soft-trunk/Controllers/OSC.h"
+#include "3d-soft-trunk/Controllers/IDCon.h"
+#include "3d-soft-trunk/Controllers/QuasiStatic.h"
+#include "3d-soft-trunk/Controllers/PID.h"
+#include "3d-soft-trunk/Controllers/LQR.h"
+#include "3d-soft-trunk/Controllers/Dyn.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <sstream>
+
+/**
+ * @file benchmark_hotpaths.cpp
+ * @brief Microbenchmarks of the model and control hot paths, for a range of segment counts and sections per segment.
+ * @details Results are written as CSV (one row per benchmark and arm configuration) so they can be compared between commits.
+ * Times are per call, in us. Construction of the objects (URDF generation, Drake setup) is not timed.
+ *
+ * Usage:
+ * ```bash
+ * ./bin/benchmark_hotpaths --segments 1,2,3 --sections 1,2 --iterations 1000 --output benchmark_hotpaths.csv --filter osc
+ * ```
+ */
+
+struct BenchmarkResult{
+    std::string name;
+    int segments;
+    int sections;
+    int iterations;
+    double mean;
+    double median;
+    double p99;
+    double min;
+    double max;
+};
+
+struct BenchmarkOptions{
+    std::vector<int> segments = {1, 2, 3};
+    std::vector<int> sections = {1, 2};
+    int iterations = 1000;
+    int warmup = 20;
+    std::string output = "benchmark_hotpaths.csv";
+    /** @brief only run benchmarks whose name contains this string */
+    std::string filter = "";
+};
+
+std::vector<int> parse_list(const std::string& s){
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        out.push_back(std::stoi(item));
+    return out;
+}
+
+/** @brief time fn for the given number of iterations (after a few untimed warmup calls) */
+BenchmarkResult run_benchmark(const std::string& name, const SoftTrunkParameters& st_params, const BenchmarkOptions& options, const std::function<void(int)>& fn){
+    for (int i = 0; i < options.warmup; i++)
+        fn(i);
+    std::vector<double> times(options.iterations);
+    for (int i = 0; i < options.iterations; i++){
+        auto start = std::chrono::steady_clock::now();
+        fn(i);
+        auto end = std::chrono::steady_clock::now();
+        times[i] = std::chrono::duration<double, std::micro>(end - start).count();
+    }
+    std::sort(times.begin(), times.end());
+    BenchmarkResult result;
+    result.name = name;
+    result.segments = st_params.num_segments;
+    result.sections = st_params.sections_per_segment;
+    result.iterations = options.iterations;
+    result.mean = std::accumulate(times.begin(), times.end(), 0.) / times.size();
+    result.median = times[times.size()/2];
+    result.p99 = times[std::min((int) times.size()-1, (int) (0.99*times.size()))];
+    result.min = times.front();
+    result.max = times.back();
+    return result;
+}
+
+/** @brief parameters for an arm with the given number of segments and sections, interpolating the default 2 segment arm */
+SoftTrunkParameters make_params(int segments, int sections, ModelType model_type, CoordType coord_type){
+    SoftTrunkParameters st_params{};
+    st_params.robot_name = fmt::format("benchmark_{}seg_{}sec", segments, sections);
+    st_params.num_segments = segments;
+    st_params.sections_per_segment = sections;
+    st_params.model_type = model_type;
+    st_params.coord_type = coord_type;
+    st_params.sensors = {SensorType::simulator};
+    st_params.masses.clear();
+    st_params.lengths.clear();
+    st_params.diameters = {0.035};
+    st_params.shear_modulus.clear();
+    st_params.drag_coef.clear();
+    st_params.chamberConfigs.clear();
+    st_params.angOffsetCoeffs.clear();
+    for (int i = 0; i < segments; i++){
+        st_params.masses.insert(st_params.masses.end(), {0.160 - 0.08*i/segments, 0.020});
+        st_params.lengths.insert(st_params.lengths.end(), {0.25/segments, 0.02});
+        st_params.diameters.push_back(0.035 - 0.015*(i+1)/segments);
+        st_params.shear_modulus.push_back(40686);
+        st_params.drag_coef.push_back(28000);
+        st_params.chamberConfigs.insert(st_params.chamberConfigs.end(), {-1, 0.5, -0.5, 0, sqrt(3)/2, -sqrt(3)/2});
+        st_params.angOffsetCoeffs.insert(st_params.angOffsetCoeffs.end(), {0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0});
+    }
+    st_params.valvemap.resize(3*segments + 1);
+    for (int i = 0; i < st_params.valvemap.size(); i++)
+        st_params.valvemap[i] = i;
+    st_params.finalize();
+    return st_params;
+}
+
+/** @brief two slightly bent test configurations, alternated between calls so that no caching can skip the computation */
+std::vector<srl::State> test_states(const SoftTrunkParameters& st_params){
+    std::vector<srl::State> states(2, st_params.getBlankState());
+    for (int i = 0; i < st_params.q_size; i++){
+        states[0].q(i) = 0.1 + 0.02*i;
+        states[1].q(i) = (i % 2 ? -0.15 : 0.12) - 0.01*i;
+        states[0].dq(i) = 0.05;
+        states[1].dq(i) = -0.05;
+    }
+    for (auto& state : states){
+        for (int i = 0; i < state.tip_transforms.size(); i++){
+            state.tip_transforms[i] = Eigen::Transform<double, 3, Eigen::Affine>::Identity();
+            state.tip_transforms[i].translation() = Vector3d(0.01*i, 0, -0.13*i);
+        }
+    }
+    if (st_params.coord_type == CoordType::phitheta){
+        for (int i = 0; i < st_params.q_size/2; i++){ // phi, theta
+            states[0].q(2*i) = 0.3*i;
+            states[1].q(2*i) = -0.5 - 0.3*i;
+        }
+    }
+    return states;
+}
+
+/** @brief q in the expanded parametrization of AugmentedRigidArm, with zero curvature connector sections */
+VectorXd expand(const SoftTrunkParameters& st_params, const VectorXd& q){
+    VectorXd q_ = VectorXd::Zero(2*st_params.num_segments*(st_params.sections_per_segment+1) + st_params.prismatic);
+    for (int i = 0; i < st_params.num_segments; i++)
+        q_.segment(2*i*(st_params.sections_per_segment+1) + st_params.prismatic, 2*st_params.sections_per_segment) = q.segment(2*i*st_params.sections_per_segment + st_params.prismatic, 2*st_params.sections_per_segment);
+    if (st_params.prismatic)
+        q_(0) = q(0);
+    return q_;
+}
+
+/** @brief benchmark one tick of a controller's control law, at a fixed state and reference */
+void benchmark_controller(const std::string& name, ControllerPCC& controller, const std::vector<srl::State>& states, const BenchmarkOptions& options, std::vector<BenchmarkResult>& results){
+    if (name.find(options.filter) == std::string::npos)
+        return;
+    // without its loops, the members can be set directly and control_tick() runs on this thread only
+    controller.stop();
+    controller.state_ = states[0];
+    controller.simulate(VectorXd::Zero(controller.st_params_.p_size)); // fills dyn_
+    controller.state_ = states[0];
+    controller.x_ref_ = Vector3d(0.02, 0.01, -0.2);
+    controller.dx_ref_ = Vector3d::Zero();
+    controller.ddx_ref_ = Vector3d::Zero();
+    controller.state_ref_ = states[1];
+    results.push_back(run_benchmark(name, controller.st_params_, options, [&](int){ controller.control_tick(); }));
+}
+
+void benchmark_configuration(int segments, int sections, const BenchmarkOptions& options, std::vector<BenchmarkResult>& results){
+    auto enabled = [&](const std::string& name){ return name.find(options.filter) != std::string::npos; };
+
+    // augmented rigid arm model, and everything built on top of it
+    {
+        SoftTrunkParameters st_params = make_params(segments, sections, ModelType::augmentedrigidarm, CoordType::thetax);
+        std::vector<srl::State> states = test_states(st_params);
+
+        if (enabled("state_copy")){
+            srl::State copy = st_params.getBlankState();
+            results.push_back(run_benchmark("state_copy", st_params, options, [&](int i){ copy = states[i%2]; }));
+        }
+
+        Model mdl{st_params}; // also generates the URDF used by the AugmentedRigidArm below
+        if (enabled("model_update_augmented"))
+            results.push_back(run_benchmark("model_update_augmented", st_params, options, [&](int i){ mdl.update(states[i%2], true); }));
+
+        VectorXd p_pseudo = VectorXd::Zero(st_params.p_pseudo_size);
+        for (int i = 0; i < st_params.p_pseudo_size; i++)
+            p_pseudo(i) = (i % 2 ? -150 : 200) + 10*i;
+        if (enabled("pseudo2real"))
+            results.push_back(run_benchmark("pseudo2real", st_params, options, [&](int i){ mdl.pseudo2real(p_pseudo*(1 + 0.1*(i%2))); }));
+
+        if (enabled("ara_calculate_m") || enabled("ara_update_Jm") || enabled("ara_reduce")){
+            AugmentedRigidArm ara{st_params};
+            std::vector<VectorXd> q_ = {expand(st_params, states[0].q), expand(st_params, states[1].q)};
+            if (enabled("ara_calculate_m"))
+                results.push_back(run_benchmark("ara_calculate_m", st_params, options, [&](int i){ ara.calculate_m(q_[i%2]); }));
+            if (enabled("ara_update_Jm"))
+                results.push_back(run_benchmark("ara_update_Jm", st_params, options, [&](int i){ ara.update_Jm(q_[i%2]); }));
+            if (enabled("ara_reduce")){
+                ara.update(states[0]);
+                results.push_back(run_benchmark("ara_reduce", st_params, options, [&](int i){ ara.reduce(); }));
+            }
+        }
+
+        if (enabled("gravity_compensate") || enabled("simulate")){
+            ControllerPCC cpcc{st_params};
+            cpcc.state_ = states[0];
+            cpcc.simulate(VectorXd::Zero(st_params.p_size));
+            if (enabled("gravity_compensate"))
+                results.push_back(run_benchmark("gravity_compensate", st_params, options, [&](int i){ cpcc.gravity_compensate(states[i%2]); }));
+            VectorXd p = 100*VectorXd::Ones(st_params.p_size);
+            if (enabled("simulate")){
+                cpcc.state_ = states[0];
+                results.push_back(run_benchmark("simulate", st_params, options, [&](int i){
+                    if (!cpcc.simulate(p))
+                        cpcc.state_ = states[0];
+                }));
+            }
+        }
+
+        if (enabled("control_osc")) { OSC c{st_params}; benchmark_controller("control_osc", c, states, options, results); }
+        if (enabled("control_idcon")) { IDCon c{st_params}; benchmark_controller("control_idcon", c, states, options, results); }
+        if (enabled("control_quasistatic")) { QuasiStatic c{st_params}; benchmark_controller("control_quasistatic", c, states, options, results); }
+        if (enabled("control_dyn")) { Dyn c{st_params}; benchmark_controller("control_dyn", c, states, options, results); }
+        if (enabled("control_lqr")) { LQR c{st_params}; benchmark_controller("control_lqr", c, states, options, results); }
+        if (enabled("control_pid") && segments <= 3) { PID c{st_params}; benchmark_controller("control_pid", c, states, options, results); } // PID gains are only defined for up to 3 segments
+    }
+
+    // the Lagrange model is hardcoded for a 2 segment phitheta robot
+    if (segments == 2 && sections == 1 && (enabled("model_update_lagrange") || enabled("lagrange_set_state"))){
+        SoftTrunkParameters st_params = make_params(segments, sections, ModelType::lagrange, CoordType::phitheta);
+        std::vector<srl::State> states = test_states(st_params);
+        Model mdl{st_params};
+        if (enabled("model_update_lagrange"))
+            results.push_back(run_benchmark("model_update_lagrange", st_params, options, [&](int i){ mdl.update(states[i%2], true); }));
+        Lagrange lag{st_params};
+        if (enabled("lagrange_set_state"))
+            results.push_back(run_benchmark("lagrange_set_state", st_params, options, [&](int i){ lag.set_state(states[i%2]); }));
+    }
+}
+
+int main(int argc, char *argv[]){
+    BenchmarkOptions options;
+    for (int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        std::string value = argv[i+1];
+        if (arg == "--segments") options.segments = parse_list(value);
+        else if (arg == "--sections") options.sections = parse_list(value);
+        else if (arg == "--iterations") options.iterations = std::stoi(value);
+        else if (arg == "--warmup") options.warmup = std::stoi(value);
+        else if (arg == "--output") options.output = value;
+        else if (arg == "--filter") options.filter = value;
+        else {
+            fmt::print("unknown option {}\n", arg);
+            return 1;
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (int segments : options.segments)
+        for (int sections : options.sections)
+            benchmark_configuration(segments, sections, options, results);
+
+    std::fstream csv;
+    csv.open(options.output, std::fstream::out);
+    csv << "benchmark,segments,sections,iterations,mean_us,median_us,p99_us,min_us,max_us\n";
+    for (auto& r : results)
+        csv << fmt::format("{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f}\n", r.name, r.segments, r.sections, r.iterations, r.mean, r.median, r.p99, r.min, r.max);
+    csv.close();
+
+    fmt::print("\n{:<24}{:>5}{:>5}{:>12}{:>12}{:>12}\n", "benchmark", "seg", "sec", "mean[us]", "median[us]", "p99[us]");
+    for (auto& r : results)
+        fmt::print("{:<24}{:>5}{:>5}{:>12.2f}{:>12.2f}{:>12.2f}\n", r.name, r.segments, r.sections, r.mean, r.median, r.p99);
+    fmt::print("results written to {}\n", options.output);
+}
@@ -1,32 +1,27 @@
-from softtrunk_pybind_module import ControllerPCC, State, CurvatureCalculator, SoftTrunkParameters
+from softtrunk_pybind_module import ControllerPCC, SensorType, SoftTrunkParameters
 import numpy as np
 
 st_params = SoftTrunkParameters()
+st_params.sensors = [SensorType.simulator]
 st_params.finalize()
 
-initial_state = st_params.getBlankState()
-# set initial state
-q = initial_state.q
-q = 2. / q.size * np.ones(q.size)
-initial_state.q = q
+# simulator functionality is provided as part of the Controller class
+ctrl = ControllerPCC(st_params)
+ctrl.dt_ = 0.01
 
-# set pressure (use size of state to figure out number of chambers)
-num_segments = initial_state.q.size // 2
-print(f"number of segements: {num_segments}")
-p = np.zeros(3 * num_segments)
+# set initial state, in place
+ctrl.state_.q[:] = 2. / st_params.q_size
 
-# simulator functionality is provided as part of the Controller class
-ctrl = ControllerPCC(st_params, CurvatureCalculator.SensorType.simulator, True)
-dt = 0.01
-ctrl.set_frequency(1./dt)
-ctrl.set_state(initial_state)
+# constant pressure on the first chamber of each segment, in mbar
+p = np.zeros(st_params.p_size)
+p[0:st_params.p_size-1:3] = 200
 
-i = 0
-while True:
+# simulate step by step...
+for i in range(10):
     ctrl.simulate(p)
-    if i == 10:
-        # once every 10 steps, print the state of robot
-        state = ctrl.get_state()
-        print(state.q)
-        i = 0
-    i += 1
\ No newline at end of file
+print(ctrl.state_.q)
+
+# ...or a whole pressure trajectory at once, one row per step of dt_
+P = np.tile(p, (1000, 1))
+Q, dQ = ctrl.simulate_many(P)
+print(f"simulated {Q.shape[0]} steps, final q: {Q[-1]}")
@@ -1,26 +1,26 @@
-from softtrunk_pybind_module import SoftTrunkModel, State, SoftTrunkParameters
+from softtrunk_pybind_module import Model, State, SoftTrunkParameters
+import numpy as np
 
 st_params = SoftTrunkParameters()
 # currently the ability to edit parameter values from the Python interface (as is done in the equivalend C++ example) is not implemented, because of lack of demand & still changing specifications.
 # plz implement yourself to src/python_bindings.cpp if needed...
 st_params.finalize()
 
-stm = SoftTrunkModel(st_params)
+mdl = Model(st_params)
 state = st_params.getBlankState()
 
-# editing elements in state
-state.q[0] = 0.1 # this method of setting elements does not work
+# state.q is a view onto the C++ state, so elements can be set in place
+state.q[0] = 0.1
+state.q[1] = -0.05
 print(state.q)
 
-q = state.q
-q[0] = 0.1
-state.q = q # this method works
-print(state.q)
-
-stm.updateState(state)
+mdl.update(state)
 
-B, c, g, K, D, A, J = stm.getModel()
-print(f"B:{B}\nc:{c}\ng:{g}\nK:{K}\nD:{D}\nA:{A}\nJ:{J}")
+# dyn_ is also a view, no copies are made until you copy yourself
+dyn = mdl.dyn_
+print(f"B:{dyn.B}\nc:{dyn.c}\ng:{dyn.g}\nK:{dyn.K}\nD:{dyn.D}\nA:{dyn.A}\nJ:{dyn.J}")
 
-H = stm.get_H(0)
-print(f"pose of tip of first segment (relative to base):\n{H}")
\ No newline at end of file
+# evaluate the model for many configurations at once, each row of Q is one configuration
+Q = np.random.uniform(-0.5, 0.5, (1000, st_params.q_size))
+res = mdl.update_many(Q)
+print(f"B: {res['B'].shape}, g: {res['g'].shape}, tip jacobian: {res['J'].shape}")
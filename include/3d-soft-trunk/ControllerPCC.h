@@ -8,6 +8,14 @@
 #include "mobilerack-interface/ValveController.h"
 #include "3d-soft-trunk/Model.h"
 #include "3d-soft-trunk/StateEstimator.h"
+#include "3d-soft-trunk/ParameterAdaptation.h"
+#include "3d-soft-trunk/TipForceEstimator.h"
+#include "3d-soft-trunk/TaskSpace.h"
+#include "3d-soft-trunk/TrajectoryGenerator.h"
+#include "3d-soft-trunk/InverseKinematics.h"
+#include "3d-soft-trunk/PCCKinematics.h"
+#include "3d-soft-trunk/Executor.h"
+#include "3d-soft-trunk/RealTime.h"
 #include <mutex>
 
 
@@ -15,19 +23,43 @@
  * @brief Base class for controllers.
  * @details Different controllers can be implemented by creating a child class of this class.
  * Includes a simulator functionality, which integrates the analytical model forward in time.
+ * With SensorType::simulated instead, the model is integrated by a SimulatedSensor on its own thread, and the sensor and model loops run as with the real arm.
  **/
 class ControllerPCC {
 public:
-    ControllerPCC(const SoftTrunkParameters st_params);
+    /** @param executor if given, the control, sensor and model loops run as tasks of the executor instead of in their own threads. Must outlive the controller */
+    ControllerPCC(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
-    ~ControllerPCC();
+    virtual ~ControllerPCC();
 
     /** @brief Set the reference state of the arm (configuration space)*/
     void set_ref(const srl::State &state_ref);
 
-    /** @brief Set the reference state of the arm (task space)*/
+    /** @brief Set the reference state of the arm (task space). Stops the trajectory generator */
     void set_ref(const Vector3d &x_ref, const Vector3d &dx_ref = Vector3d::Zero(), const Vector3d &ddx_ref = Vector3d::Zero());
 
+    /** @brief Set a task space reference for a configuration space controller. Stops the trajectory generator
+     * @details On every control tick, state_ref_ is solved from x_ref_ with inverse kinematics, starting from the previous solution.
+     * Waypoints added afterwards are followed the same way, until the next set_ref(state_ref). */
+    void set_ref_ik(const Vector3d &x_ref, const Vector3d &dx_ref = Vector3d::Zero());
+
+    /** @brief Queue a task space waypoint for the trajectory generator, which sets x_ref_, dx_ref_, ddx_ref_ on every control tick
+     * @details The trajectory starts at the current reference, or at the current tip position if no reference was set yet
+     * @param duration time to reach the waypoint in s, 0 to choose it from the limits of trajectory_
+     * @param replace_pending drop the waypoints which are still queued, for streamed targets */
+    void add_waypoint(const Vector3d &x, double duration = 0, bool replace_pending = false);
+
+    /** @brief Drop all queued waypoints, the reference stays where the trajectory currently is */
+    void clear_waypoints();
+
+    /** @brief Trajectory generator, the limits can be set directly */
+    TrajectoryGenerator trajectory_;
+
+    /** @brief Inverse kinematics used by set_ref_ik(), the curvature limit and tolerances can be set directly */
+    std::unique_ptr<InverseKinematics> ik_;
+    /** @brief Residual tip error of the latest inverse kinematics reference, in m */
+    double ik_error_ = 0;
+
 
     /** @brief Toggles logging of x,q to a csv file, filename is defined in string filename_  */
     void toggle_log();
@@ -36,6 +68,15 @@ public:
     *   @return If the simulation was successful (true) or overflowed (false) */
     bool simulate(const VectorXd &p);
 
+    /** @brief Run the control law once on the current state and reference, without actuating
+     * @details Lets a controller be benchmarked or tested without its control loop, see stop(). The result is stored in p_.
+     * @return false if the controller does not compute a pressure */
+    bool control_tick();
+
+    /** @brief Stop the control, sensor and model loops, and wait until they have finished
+     * @details Afterwards the members can be written without mtx, e.g. to call control_tick() from the caller's thread. The loops can not be restarted */
+    void stop();
+
     /** @brief Toggles gripper */
     void toggleGripper();
 
@@ -43,13 +84,25 @@ public:
      * @param p Pressure vector, 3 pressures per segment for default SoPrA*/
     void actuate(const VectorXd &p);
 
+    /** @brief Send the pressures of all chambers to the valve controller as one update
+     * @details Only chambers whose pressure changed by more than st_params_.valve_change_threshold since the last command are sent.
+     * With SensorType::simulated, they are applied to the simulated arm instead.
+     * @param p Pressure vector in mbar (size: p_size) */
+    void setPressures(const VectorXd &p);
+
     bool gripperAttached_ = false;
 
-    /** @brief Load attached to the tip of the arm, in Newton*/
-    double loadAttached_ = 0.;
+    /** @brief External force on the tip estimated from the model residual of every new measurement, in N, see TipForceEstimator */
+    Vector3d tip_force();
+
+    /** @brief Take the current model residual as the offset of no external force, averaged over the next samples measurements. Call while nothing touches the tip */
+    void tare_tip_force(int samples = 50);
 
     // arm configuration
     srl::State state_;
+    /** @brief State the control law acts on: state_ predicted to the actuation time by compensate_latency(), or a copy of state_ if it is disabled.
+     * state_ itself always holds the latest measurement, for the model loop, the tip force estimate and the log */
+    srl::State state_pred_;
     Vector3d x_;
     Vector3d dx_;
     Vector3d ddx_;
@@ -76,47 +129,126 @@ public:
     /** @brief Actuation torques (size: q_size) */
     VectorXd f_;
 
+    /** @brief Measured time between measurement of the state and actuation, in s (moving average) */
+    double latency_ = 0;
+    /** @brief Time taken to send the latest pressure command to the valve controller, in s */
+    double command_latency_ = 0;
+    /** @brief Number of single chamber commands sent / suppressed because the pressure did not change */
+    unsigned long int commands_sent_ = 0;
+    unsigned long int commands_suppressed_ = 0;
+    /** @brief Horizon of the latest latency compensation prediction, in s */
+    double prediction_horizon_ = 0;
+    /** @brief Norm of the change in q caused by the latest latency compensation prediction */
+    double prediction_correction_ = 0;
+    /** @brief Continuous singularity measure of the tip jacobian in the latest tick of a task space controller (OSC, IDCon, QuasiStatic), see TaskSpace::singularity_measure() */
+    double singularity_measure_ = 0;
+    /** @brief Number of model updates which were computed / which reused the previous results because the state did not change, see Model::update() */
+    unsigned long int model_updates_computed() const;
+    unsigned long int model_updates_skipped() const;
+
     /**
      * @brief Determine a pseudopressure which will compensate for gravity + state related forces
      * @details Effectively makes the arm "weightless", i.e. PID control should work
      * @param state state for which should be equalized
      * @return VectorXd of pseudopressures, unit mbar
      */
-    VectorXd gravity_compensate(const srl::State state);
+    VectorXd gravity_compensate(const srl::State& state);
 protected:
+    /** @brief Control law of the controller, computes p_ from state_pred_, dyn_ and the reference. Called with mtx locked.
+     * @return false if no pressure should be applied */
+    virtual bool control_law();
 
+    /** @brief Start running control_step() at 1/dt_, in control_thread_ or as a task of the executor. Derived controllers call it at the end of their constructor */
+    void start_control();
 
+    /** @brief Runs control_law() and actuates its result once a reference has been received */
+    void control_step();
 
+    /** @brief Runs control_step() at 1/dt_ */
+    void control_loop();
+
+    /** @brief Set state_pred_ to the state at the expected actuation time, by forward integrating state_ with dyn_ and the last applied pressure p_.
+     * @details Call at the start of the control tick. Unless st_params_.latency_compensation is set, state_pred_ is a copy of state_.
+     * The horizon is the age of the measurement plus the measured time the control law takes until actuation. Only q, dq and ddq are predicted,
+     * the tip position is predicted in x_prediction_ with PCC kinematics, as the displacement from the measured one (which keeps the tip on the measured frame). */
+    void compensate_latency();
 
     /** @brief Check if J is in a singularity (within a threshold)
+    *   @details Counts the pairs of segments whose jacobian columns span the same plane, which decides how the task space controllers perturb J.
+    *   The continuous measure of task_space_ is recorded in singularity_measure_ instead
     *   @return Order of the singularity */
     int singularity(const MatrixXd &J);
 
+    /** @brief Task space factorization of the tip jacobian, updated by the task space controllers once per tick */
+    TaskSpace task_space_;
+
     /** @brief Pointer to the Model object */
     std::unique_ptr<Model> mdl_;
+    /** @brief Model updated on the control thread, only exists if st_params_.dynamics_update_rate is set
+     * @details Refreshes J and g of dyn_ on every control tick, while mdl_ refreshes B and c at dynamics_update_rate. dyn_.kinematics_timestamp and dyn_.dynamics_timestamp tell the state each part was computed at */
+    std::unique_ptr<Model> kinematics_mdl_;
     /** @brief Pointer to the StateEstimator object */
     std::unique_ptr<StateEstimator> ste_;
     /** @brief Pointer to the ValveController object */
     std::unique_ptr<ValveController> vc_;
+    /** @brief Pointer to the ParameterAdaptation object, only exists if st_params_.parameter_adaptation is set */
+    std::unique_ptr<ParameterAdaptation> adaptation_;
+    /** @brief Estimator of the external tip force, updated at the start of the control tick after each new measurement, with the measured state and the last applied pressure */
+    std::unique_ptr<TipForceEstimator> tip_force_;
+    /** @brief PCC kinematics of the tip, for the tip displacement over the latency compensation horizon */
+    std::unique_ptr<PCCKinematics> tip_kinematics_;
+    /** @brief change of the tip position from state_ to state_pred_, added to the measured tip position in x_ */
+    Vector3d x_prediction_ = Vector3d::Zero();
 
     double t_ = 0;
 
     bool is_initial_ref_received = false;
 
+    /** @brief state_ref_ follows x_ref_ through ik_ */
+    bool ik_reference_ = false;
+    /** @brief Solve state_ref_ from x_ref_ and dx_ref_, starting from the previous solution */
+    void update_ik_ref();
+
     std::thread control_thread_;
     std::thread sensor_thread_;
     std::thread model_thread_;
 
     /** @brief This loop fetches sensor data from the StateEstimator with refresh rate from YAML */
     void sensor_loop();
+    void sensor_step();
 
-    /** @brief This loop fetches dynamic parameters from the Model with refresh rate from YAML */
+    /** @brief This loop fetches dynamic parameters from the Model with refresh rate from YAML (dynamics_update_rate if set, else model_update_rate)
+     * @details With parameter adaptation, K, D and A are replaced by the latest adapted ones, and every state is passed on to the adaptation.
+     * If J and g are refreshed on the control thread, the fresher ones are kept */
     void model_loop();
+    void model_step();
+    double model_rate() const;
+
+    /** @brief executor running the loops, nullptr if they run in their own threads */
+    Executor* executor_;
+    /** @brief ids of the tasks of this controller in executor_ */
+    std::vector<int> tasks_;
 
     std::mutex mtx;
 
     bool gripping_ = false;
 
+    /** @brief timestamp of the last state passed on to the parameter adaptation, in us */
+    unsigned long long int sample_timestamp_ = 0;
+
+    /** @brief last pressure sent to each chamber, in mbar. -1 if nothing has been sent yet */
+    VectorXi p_sent_;
+    std::mutex valve_mtx;
+
+    /** @brief timestamp of the latest measurement copied to state_, in us */
+    unsigned long long int measurement_timestamp_ = 0;
+    /** @brief timestamp of the state_ the tip force was last estimated from, in us */
+    unsigned long long int tip_force_timestamp_ = 0;
+    /** @brief time at which the current control tick started, in us */
+    unsigned long long int tick_start_ = 0;
+    /** @brief measured time from start of the control tick until actuation, in s (moving average) */
+    double compute_delay_ = 0;
+
     //logging variables
     bool logging_ = false;
     unsigned long long int initial_timestamp_;
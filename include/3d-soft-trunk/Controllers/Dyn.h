@@ -6,10 +6,10 @@
 class Dyn: public ControllerPCC
 {
 public:
-    Dyn(const SoftTrunkParameters st_params);
+    Dyn(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
 private:
-    void control_loop();
+    bool control_law() override;
     
     VectorXd Kp;
     VectorXd Kd;
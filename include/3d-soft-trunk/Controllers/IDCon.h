@@ -12,10 +12,10 @@
  * @details Similar to OSC, but uses Jacobian inversion instead of Operational Space Inertia Matrix */
 class IDCon: public ControllerPCC {
 public:
-    IDCon(const SoftTrunkParameters st_params);
+    IDCon(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
 private:
-    void control_loop();
+    bool control_law() override;
     /** @brief gains for ID*/
     double kp;
     double kd;
@@ -29,5 +29,4 @@ private:
     VectorXd tau_ref;
     double eps;
     double lambda;
-    Eigen::MatrixXd computePinv(Eigen::MatrixXd j, double e, double lambda);
 };
\ No newline at end of file
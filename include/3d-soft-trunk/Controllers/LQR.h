@@ -6,7 +6,7 @@
 class LQR: public ControllerPCC
 {
 public:
-    LQR(const SoftTrunkParameters st_params);
+    LQR(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
     /** @brief realinearize the LQR controller, takes quite a while */
     void relinearize();
@@ -15,7 +15,7 @@ public:
     void setcosts(MatrixXd &Q, MatrixXd &R);
 
 private:
-    void control_loop();
+    bool control_law() override;
     /** @brief solve the riccati equation for given matrixes, stolen from https://github.com/TakaHoribe/Riccati_Solver
     *   @details Overview of LQR/Riccati is here: https://en.wikipedia.org/wiki/Linear%E2%80%93quadratic_regulator#Infinite-horizon,_continuous-time_LQR
     */
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "3d-soft-trunk/ControllerPCC.h"
+#include "3d-soft-trunk/WholeBodyAvoidance.h"
 
 /** @brief Potential field to avoid task space objects */
 class PotentialField{
@@ -25,21 +26,30 @@ class OSC: public ControllerPCC
 {
 public:
 
-    OSC(const SoftTrunkParameters st_params);
+    OSC(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
     /* @brief vector containing all potential fields */
     std::vector<PotentialField> potfields_;
 
     bool freeze = false;
 
+    /** @brief push the whole arm away from the objects with avoidance_, instead of only the tip with potfields_ */
+    bool whole_body_avoidance_ = false;
+
+    /** @brief whole body avoidance, the objects are the positions of potfields_ with their radius */
+    std::unique_ptr<WholeBodyAvoidance> avoidance_;
+
     /** @brief proportional gain */
     double kp_;
 
     /** @brief derivative gain */
     double kd_;
 
+    /** @brief counteract the external tip force estimated by tip_force_ (which includes the gripper), instead of only the known weight of the gripper */
+    bool force_compensation_ = false;
+
 private:
-    void control_loop();
+    bool control_law() override;
 
     /** @brief operational dynamics */
     MatrixXd B_op;
@@ -62,7 +72,9 @@ private:
     MatrixXd B_op_null;
     VectorXd f_null;
 
-    /** @brief pseudoinverse of a matrix */
-    MatrixXd computePinv(MatrixXd j,double e,double lambda);
+    /** @brief obstacles last passed to avoidance_, and its cutoff distance at that time. The spatial index is only rebuilt when they change */
+    std::vector<Vector3d> obstacle_centers_;
+    std::vector<double> obstacle_radii_;
+    double obstacle_cutoff_ = 0;
     
 };
\ No newline at end of file
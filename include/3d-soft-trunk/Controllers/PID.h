@@ -6,10 +6,10 @@
 class PID: public ControllerPCC 
 {
 public:
-    PID(const SoftTrunkParameters st_params);
+    PID(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
 private:
-    void control_loop();
+    bool control_law() override;
 
     // parameters for PID controller
     std::array<double, 3> Ku = {3000, 2500, 2000}; /** @brief ultimate gain for each segment, used in Ziegler-Nichols method */
@@ -5,10 +5,10 @@
 /** @brief Task Space Jacobian Controller using a Quasi-Static assumption */
 class QuasiStatic: public ControllerPCC{
 public:
-    QuasiStatic(const SoftTrunkParameters st_params);
+    QuasiStatic(const SoftTrunkParameters st_params, Executor* executor = nullptr);
 
 private: 
-    void control_loop();
+    bool control_law() override;
     double kp;
     double kd;
     VectorXd p_prev = VectorXd::Zero(st_params_.p_pseudo_size);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/Model.h"
+
+/**
+ * @brief Offline generation of training data for learned dynamics models.
+ * @details Every sample is a state (q, dq) and a pressure p, either drawn at random or replayed from logs.
+ * For each sample, the model is evaluated (B, c, g and the tip jacobian J of each segment), and the state after dt_ under constant p is simulated.
+ * The samples are split over several threads, each with its own Model. Each thread writes its own shard file, in chunks of chunk_size_ samples, so the threads never wait for each other.
+ *
+ * A shard is a flat array of records without header, of double (or float with single_precision_) values:
+ * q, dq, p, B (row major), c, g, J of each segment (row major, 3 x q_size each), q_next, dq_next.
+ * manifest.yaml in the same directory lists the fields with their offset and shape, the shards with their number of samples, the settings used, and the constant K, D, A and A_pseudo (row major), so e.g. numpy can read a shard with `np.fromfile(shard, dtype).reshape(-1, record_size)`.
+ */
+class DatasetGenerator{
+public:
+    /** @param num_threads number of worker threads, each with its own Model */
+    DatasetGenerator(const SoftTrunkParameters& st_params, int num_threads = std::thread::hardware_concurrency());
+
+    /** @brief replay the states and pressures of a log written by ControllerPCC::toggle_log() instead of random samples
+     * @details dq is obtained by central differences of q. Can be called several times to add more logs
+     * @return false if the file could not be read */
+    bool load_log(const std::string& filename);
+
+    /** @brief evaluate the samples and write the dataset
+     * @param directory created if it does not exist, existing shards are overwritten
+     * @param num_samples number of random samples, ignored if logs were loaded (all logged samples are used)
+     * @return number of samples written */
+    long long int generate(const std::string& directory, long long int num_samples);
+
+    /** @brief random samples are drawn uniformly: each element of q in [-q_range_, q_range_] (theta in [0, q_range_] and phi in [-pi, pi] for phitheta),
+     * dq in [-dq_range_, dq_range_], and each pressure in [p_min_, p_max_] in mbar */
+    double q_range_ = 0.6;
+    double dq_range_ = 2.;
+    double p_min_ = 0;
+    double p_max_;
+    /** @brief time step of the simulated next state in s, defaults to the control period */
+    double dt_;
+    /** @brief integration step used to simulate the next state, in s */
+    double substep_ = 0.00001;
+    /** @brief samples per chunk, written at once */
+    int chunk_size_ = 4096;
+    /** @brief write floats instead of doubles */
+    bool single_precision_ = false;
+    unsigned int seed_ = 0;
+
+    /** @brief name and number of values of each field of a record, in order */
+    std::vector<std::pair<std::string, std::vector<int>>> fields() const;
+    int record_size() const;
+
+private:
+    /** @brief fill the record of one sample
+     * @param record record_size() values */
+    void evaluate(Model& mdl, const srl::State& state, const VectorXd& p, double* record) const;
+
+    /** @brief write manifest.yaml, describing the layout of the records and the shards
+     * @param samples number of samples in each shard */
+    void write_manifest(const std::string& directory, const std::vector<std::string>& shards, const std::vector<long long int>& samples, bool replay) const;
+
+    const SoftTrunkParameters st_params_;
+    const int num_threads_;
+
+    /** @brief one Model per worker thread */
+    std::vector<std::unique_ptr<Model>> models_;
+
+    /** @brief replayed samples, empty for random samples */
+    std::vector<srl::State> samples_;
+    std::vector<VectorXd> pressures_;
+};
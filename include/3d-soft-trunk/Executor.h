@@ -0,0 +1,55 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+
+/**
+ * @brief Fixed pool of worker threads which runs periodic tasks, so several controllers can share one process without a thread per loop.
+ * @details Tasks are scheduled by deadline: a task is due one period after its previous deadline, the worker which is free first runs the task with the earliest deadline.
+ * A task never runs concurrently with itself. If a task overruns its period, the missed deadlines are skipped instead of being run back to back.
+ */
+class Executor{
+public:
+    /** @param num_workers number of worker threads */
+    Executor(int num_workers = std::thread::hardware_concurrency());
+
+    ~Executor();
+
+    /** @brief run step at rate hz, starting now
+     * @return id of the task, for remove_task() */
+    int add_task(std::function<void()> step, double hz);
+
+    /** @brief stop running the task, waits until the task is not running anymore. Must not be called from the task itself */
+    void remove_task(int id);
+
+    /** @brief number of times a task started later than one period after its deadline */
+    unsigned long int missed_deadlines() const { return missed_deadlines_; }
+
+    int num_workers() const { return workers_.size(); }
+
+private:
+    struct Task{
+        std::function<void()> step;
+        unsigned long long int period;
+        bool running = false;
+    };
+
+    void worker_loop();
+
+    /** @brief tasks by id, and the next deadline (monotonic time in us) of each task which is not running, earliest first */
+    std::map<int, Task> tasks_;
+    typedef std::pair<unsigned long long int, int> Deadline;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines_;
+    int next_id_ = 0;
+    unsigned long int missed_deadlines_ = 0;
+
+    std::mutex mtx_;
+    /** @brief notifies workers of new tasks, and remove_task() of finished steps */
+    std::condition_variable cv_;
+    std::vector<std::thread> workers_;
+    bool run_ = true;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/Model.h"
+
+/**
+ * @brief Linear regression form of the dynamics of one segment, in the unknowns theta = [G, drag, C(0,0), C(0,1), C(0,2), C(1,0), C(1,1), C(1,2)]
+ * @details The rows of the segment in \f$ K q + D \dot q - A p = -(B \ddot q + c + g) \f$ are linear in theta: \f$ K = G k_0 \f$, \f$ D = d\, d_0 \f$ and \f$ A p = a_0 C p \f$,
+ * where \f$ k_0, d_0, a_0 \f$ depend only on the geometry of the arm. They are obtained from the dynamic parameters of a SoftTrunkModel.
+ */
+class ParameterRegressor{
+public:
+    /** @param dyn dynamic parameters of the arm with parameters st_params (K, D and A are constant for SoftTrunkModel) */
+    ParameterRegressor(const SoftTrunkParameters& st_params, const DynamicParams& dyn);
+
+    /** @brief regression rows of one segment for one sample
+     * @param rest B*ddq + c + g at the state of the sample
+     * @param p chamber pressures in mbar (size p_size)
+     * @param Phi regressor (2*sections_per_segment x num_unknowns)
+     * @param y right hand side (2*sections_per_segment) */
+    void compute(int segment, const VectorXd& rest, const srl::State& state, const VectorXd& p, MatrixXd& Phi, VectorXd& y) const;
+
+    /** @brief parameters of the segment in the dynamic parameters given to the constructor */
+    VectorXd nominal(int segment) const;
+
+    /** @brief overwrite the K, D and A entries of the segment in dyn with those of parameters theta */
+    void apply(int segment, const VectorXd& theta, DynamicParams& dyn) const;
+
+    static const int num_unknowns = 8;
+
+private:
+    const SoftTrunkParameters st_params_;
+    /** @brief geometric stiffness, damping and actuation coefficients of each q, so that K = G*k0, D = drag*d0, A_pseudo = a0 */
+    VectorXd k0_;
+    VectorXd d0_;
+    VectorXd a0_;
+    /** @brief chamber configuration of each segment in the A matrix given to the constructor */
+    std::vector<MatrixXd> chamber_config_;
+};
+
+/** @brief read a log written by ControllerPCC::toggle_log()
+ * @details columns are found by header name (timestamp, q_i, p_i). Lines which are incomplete or not newer than the previous one are skipped
+ * @param t timestamps in s
+ * @param q configurations (size q_size)
+ * @param p chamber pressures in mbar (size p_size)
+ * @return false if the file could not be read or does not contain all columns */
+bool read_log(const std::string& filename, const SoftTrunkParameters& st_params, std::vector<double>& t, std::vector<VectorXd>& q, std::vector<VectorXd>& p);
+
+/** @brief Parameters of one segment, as fitted by Identification */
+struct SegmentFit{
+    double shear_modulus = 0;
+    double drag_coef = 0;
+    /** @brief chamber configuration, maps the 3 chamber pressures to x,y pseudopressures */
+    MatrixXd chamber_config = MatrixXd::Zero(2,3);
+    /** @brief RMS residual torque on the training data (all samples) and averaged over the cross validation folds, in Nm */
+    double rms_train = 0;
+    double rms_validation = 0;
+    int samples = 0;
+};
+
+/**
+ * @brief Offline system identification from logged data.
+ * @details Fits the shear modulus, drag coefficient and chamber configuration of each segment to logged q and p, by least squares on the dynamic equation (see ParameterRegressor).
+ * B, c and g are evaluated with the model for every sample. The samples are split over several threads, each with its own Model, and the normal equations are accumulated in parallel.
+ * The fit is cross validated with k contiguous folds.
+ */
+class Identification{
+public:
+    /** @param st_params parameters of the arm, the fitted parameters are initialized from these
+     * @param num_threads number of worker threads, each with its own Model */
+    Identification(const SoftTrunkParameters& st_params, int num_threads = std::thread::hardware_concurrency());
+
+    /** @brief add the samples of a log written by ControllerPCC::toggle_log()
+     * @details columns are found by header name (timestamp, q_i, p_i). Velocities and accelerations are obtained by central differences of the smoothed q.
+     * @return false if the file could not be read */
+    bool load_log(const std::string& filename);
+
+    /** @brief fit the parameters of all segments to the loaded samples, and store them in new_params_
+     * @param folds number of cross validation folds */
+    void identify(int folds = 5);
+
+    /** @brief number of samples used to smooth q before differentiating */
+    int smoothing_window_ = 5;
+
+    /** @brief identified parameters. Write them with new_params_.write_yaml() */
+    SoftTrunkParameters new_params_;
+
+    /** @brief fit of each segment, filled in by identify() */
+    std::vector<SegmentFit> fits_;
+
+private:
+    const SoftTrunkParameters st_params_;
+    const int num_threads_;
+
+    /** @brief one Model per worker thread */
+    std::vector<std::unique_ptr<Model>> models_;
+
+    std::unique_ptr<ParameterRegressor> regressor_;
+
+    std::vector<srl::State> samples_;
+    /** @brief chamber pressures of each sample, in mbar */
+    std::vector<VectorXd> pressures_;
+
+    /** @brief normal equations of one segment, accumulated over a set of samples */
+    struct NormalEquations{
+        MatrixXd AtA = MatrixXd::Zero(ParameterRegressor::num_unknowns, ParameterRegressor::num_unknowns);
+        VectorXd Atb = VectorXd::Zero(ParameterRegressor::num_unknowns);
+        double btb = 0;
+        int rows = 0;
+        void add(const NormalEquations& other);
+        void subtract(const NormalEquations& other);
+        /** @brief least squares solution, with the columns scaled to unit norm to cope with the very different magnitudes of the unknowns */
+        VectorXd solve() const;
+        /** @brief sum of squared residuals of the solution x */
+        double sse(const VectorXd& x) const;
+    };
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/PCCKinematics.h"
+
+/**
+ * @brief Inverse kinematics of the tip, to obtain configuration space references from task space targets.
+ * @details Damped least squares iterations \f$ \Delta q = J^T (J J^T + \lambda^2 I)^{-1} e \f$ on the closed form PCC kinematics (PCCKinematics), starting from the given q.
+ * Called with the previous solution, a slowly moving target converges in a few iterations.
+ * After every step, the bending angle of each section is clamped to max_curvature_ times its length.
+ * Optionally, the direction of the tip axis (z axis of the tip frame) is also a target. The arm can not twist, so this is the only orientation which can be specified.
+ * Its jacobian is obtained from the points at both ends of the tip connector, so it needs a connector of nonzero length.
+ * Targets are expressed in the frame of the tip transforms of the state, like x_ref_ of ControllerPCC.
+ */
+class InverseKinematics{
+public:
+    InverseKinematics(const SoftTrunkParameters& st_params);
+
+    /** @brief solve for a tip position
+     * @param q initial guess, overwritten by the solution
+     * @return true if the tip is within tolerance_ of x */
+    bool solve(const Vector3d& x, VectorXd& q);
+
+    /** @brief solve for a tip position and tip axis direction
+     * @param direction target of the z axis of the tip frame, need not be normalized */
+    bool solve(const Vector3d& x, const Vector3d& direction, VectorXd& q);
+
+    /** @brief solve many targets on several threads, e.g. to convert a task space trajectory offline
+     * @details The targets are split into contiguous chunks, one per thread. Within a chunk, every target starts from the solution of the previous one.
+     * The first target of each chunk starts from q_init, with 10 times the iterations.
+     * @param q solutions, resized to the number of targets
+     * @param directions targets of the tip axis, empty for position only
+     * @return number of targets that did not converge */
+    int solve_batch(const std::vector<Vector3d>& x, const VectorXd& q_init, std::vector<VectorXd>& q, int num_threads = std::thread::hardware_concurrency(), const std::vector<Vector3d>& directions = {});
+
+    /** @brief joint velocity which moves the tip with velocity dx, at the latest solution */
+    VectorXd velocity(const Vector3d& dx) const;
+
+    /** @brief clamp the bending angle of each section of q to max_curvature_ */
+    void clamp(VectorXd& q) const;
+
+    /** @brief residual error and iterations of the latest solve. The error includes the weighted direction error */
+    double error() const { return error_; }
+    int iterations() const { return iterations_; }
+
+    /** @brief damping lambda, in m */
+    double damping_ = 0.01;
+    /** @brief converged when the error is below, in m */
+    double tolerance_ = 1e-4;
+    int max_iterations_ = 20;
+    /** @brief largest change of q in one iteration */
+    double max_step_ = 0.2;
+    /** @brief largest curvature of a section, in 1/m. The bending angle of a section is limited to max_curvature_ times its length */
+    double max_curvature_ = 12.;
+    /** @brief weight of the direction error relative to the position error, in m */
+    double direction_weight_ = 0.05;
+
+private:
+    bool solve(const Vector3d& x, const Vector3d* direction, VectorXd& q, int max_iterations);
+
+    const SoftTrunkParameters st_params_;
+    /** @brief end of the sections and tip of the last segment */
+    PCCKinematics kinematics_;
+    const double connector_;
+
+    /** @brief position jacobian of the tip at the latest solution */
+    MatrixXd J_;
+    double error_ = 0;
+    int iterations_ = 0;
+};
@@ -3,9 +3,11 @@
 #include "3d-soft-trunk/SoftTrunk_common.h"
 #include "3d-soft-trunk/Models/SoftTrunkModel.h"
 #include "3d-soft-trunk/Models/Lagrange.h"
+#include "3d-soft-trunk/Models/NeuralModel.h"
+#include <atomic>
 
 /** @brief The model object's purpose is determining matrices of the dynamic equation. It does NOT estimate state, it uses state to estimate inertia, gravity etc.
- * @details The model object acts as a funnel for all possible models. Currently, choices are an Augmented Rigid Arm (variable segments) or Lagrangian Energy (2 segment hardcoded)
+ * @details The model object acts as a funnel for all possible models. Currently, choices are an Augmented Rigid Arm (variable segments), Lagrangian Energy (2 segment hardcoded) or a learned NeuralModel
 */
 class Model{
 public:
@@ -13,9 +15,22 @@ public:
 
     ~Model();
 
-    /** @brief Forces model object to update dynamic parameters
-     * @param state Configuration of the arm for which dynamic parameters should be obtained*/
-    void update(const srl::State& state);
+    /** @brief Update the dynamic parameters, unless the state did not change meaningfully since the last update
+     * @details The results are reused if state has the same (nonzero) timestamp as the state of the last update, i.e. it is the same measurement,
+     * or if no element of q and dq changed by more than st_params_.model_q_threshold and model_dq_threshold.
+     * @param state Configuration of the arm for which dynamic parameters should be obtained
+     * @param force always recompute
+     * @return true if the parameters were recomputed */
+    bool update(const srl::State& state, bool force = false);
+
+    /** @brief Update only the jacobians and gravity, which are cheaper than the inertia and coriolis terms. Skipped like update(), only depending on q
+     * @details Used to refresh them at a higher rate than the full update. The Lagrange and neural models evaluate everything at once, and always update everything
+     * @return true if they were recomputed */
+    bool update_kinematics(const srl::State& state, bool force = false);
+
+    /** @brief Number of updates which were computed and which reused the previous results, both for update() and update_kinematics() */
+    std::atomic<unsigned long int> updates_computed_{0};
+    std::atomic<unsigned long int> updates_skipped_{0};
 
     /** @brief Converts x,y pseudopressures to "real" pressures which can be sent to the chambers */
     VectorXd pseudo2real(VectorXd p_pseudo);
@@ -34,8 +49,16 @@ private:
     std::unique_ptr<Lagrange> lag_;
     /** @brief Pointer to the SoftTrunkModel (AugmentedRigidArm) object */
     std::unique_ptr<SoftTrunkModel> stm_;
+    /** @brief Pointer to the NeuralModel object */
+    std::unique_ptr<NeuralModel> nn_;
 
     MatrixXd chamber_inv_;
 
+    /** @brief true if state is close enough to last to reuse the results computed at last */
+    bool unchanged(const srl::State& state, const srl::State& last, bool compare_dq) const;
+    /** @brief states the last update() and update_kinematics() were computed at, empty before the first */
+    srl::State dynamics_state_;
+    srl::State kinematics_state_;
+
     std::mutex mtx;
 };
\ No newline at end of file
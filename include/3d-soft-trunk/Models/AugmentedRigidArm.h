@@ -57,13 +57,15 @@ private:
      */
     void setup_drake_model();
 
-    /** @brief calculate joint angles of rigid model, for a PCC configuration q_. */
-    void calculate_m(VectorXd q_);
-
     /** @brief update the Drake model using the current xi_, and calculate dynamic parameters B_xi_ and G_xi_. */
     void update_drake_model();
-
-    void update_Jm(VectorXd q_);
+    /** @brief set xi_, dxi_ in the Drake model, and calculate g_xi_, Jxi_ and H_list */
+    void update_drake_kinematics();
+    /** @brief calculate B_xi_ and c_xi_ at the xi_, dxi_ of the last update_drake_kinematics() */
+    void update_drake_dynamics();
+    /** @brief the parts of reduce() for g, J and for B, c */
+    void reduce_kinematics();
+    void reduce_dynamics();
 
     void update_dJm(const VectorXd& q_, const VectorXd &dq_);
 
@@ -86,10 +88,16 @@ private:
     /** @brief coriolis factorization matrix */
     MatrixXd S_xi_;
     /**
-     * @brief matrix that maps from the [2 Nsegments] DoF parameters to [2 (Nsegment+1)] DoF parameters used internally.
-     * e.g. q_ = map_normal2expanded * q
+     * @brief index of the first coordinate in q_ and of the first joint in xi_ of each PCC section of q (i.e. without the connector sections).
+     * @details The map from q to q_ is a selection, and the columns of Jm_ of a section are only nonzero in the 10 joints of that section and the following one.
+     * The mappings between q and xi_ are done as products with these 10x2 blocks of Jm_, so their cost grows linearly with the number of sections instead of cubically.
      */
-    MatrixXd map_normal2expanded;
+    std::vector<int> q_head_;
+    std::vector<int> xi_head_;
+    /** @brief q with the extra connector sections, whose values are 0 */
+    VectorXd expand(const Ref<const VectorXd>& q) const;
+    /** @brief B_xi_ * Jm_ mapped to q */
+    MatrixXd BJ_;
 
     /** @brief holds relative transforms between tip of each segment (tip of curving section, disregards the connector part) and base */
     std::vector<Eigen::Transform<double, 3, Eigen::Affine>> H_list;
@@ -103,6 +111,20 @@ public:
     /** @brief update the member variables based on current PCC value */
     void update(const srl::State &state);
 
+    /** @brief update only g, J and the poses of the segments, which are cheaper than B and c */
+    void update_kinematics(const srl::State &state);
+
+    /** @brief calculate joint angles of rigid model, for a PCC configuration q_.
+     * @details q_ has the extra connector sections (size 2*num_segments*(sections_per_segment+1)+prismatic).
+     * Called by update(), public so that it can be benchmarked on its own */
+    void calculate_m(VectorXd q_);
+
+    /** @brief calculate Jm_, the Jacobian that maps from q_ to xi_. Called by update() */
+    void update_Jm(VectorXd q_);
+
+    /** @brief map B_xi_, c_xi_, g_xi_ and Jxi_ to B, c, g and J with Jm_. Called by update(), public so that it can be benchmarked on its own */
+    void reduce();
+
     /** @brief simulate the rigid body model in Drake. The prismatic joints are broken... */
     void simulate();
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+
+/**
+ * @brief Learned surrogate of the dynamic model, a small multilayer perceptron trained on data of DatasetGenerator (see apps/train_neural_model.py).
+ * @details The network maps the normalized state [q, dq] through tanh hidden layers and a linear output layer to:
+ * - L: lower triangle of the Cholesky factor of B, row by row, with the log of the diagonal, so that \f$ B = L L^T \f$ is always positive definite
+ * - c, g: coriolis and gravity torques
+ * - J: jacobian of each segment tip, row major
+ * - residual (optional): torque the analytical model misses, e.g. fitted to logs of the real arm. It is added to c, since all controllers use c as an additive torque.
+ *
+ * K, D, A and A_pseudo are constant for the augmented model, and are stored in the weights file. S, dJ and x are not learned and stay zero.
+ * The weights are stored as floats, and all buffers are allocated when loading them, so set_state() does not allocate. The matrix-vector products are vectorized by Eigen.
+ *
+ * The weights file is a YAML file with the keys q size, p size, num segments, input mean and input scale (\f$ x = (x_{raw} - mean) \cdot scale \f$),
+ * layers (a list of rows, cols, row major weights and bias), outputs (a list of name and size, in order), output mean and output scale (\f$ y = y_{raw} \cdot scale + mean \f$),
+ * and K, D, A, A_pseudo (row major).
+ */
+class NeuralModel{
+public:
+    /** @brief load the weights file st_params.neural_weights
+     * @throws std::runtime_error if the file cannot be read, or its dimensions do not match the arm or each other */
+    NeuralModel(const SoftTrunkParameters& st_params);
+
+    /** @brief evaluate the network at state, and update dyn_ */
+    void set_state(const srl::State &state);
+
+    const SoftTrunkParameters st_params_;
+    DynamicParams dyn_;
+
+    /** @brief number of layers (hidden and output) and the largest width, for reports */
+    int num_layers() const { return weights_.size(); }
+    int max_width() const { return act_a_.size(); }
+
+private:
+    /** @brief read the weights file, and allocate all buffers */
+    void load(const std::string& filename);
+
+    /** @brief evaluate the network on input_, the output is written to output_ */
+    void forward();
+
+    std::vector<Eigen::MatrixXf> weights_;
+    std::vector<Eigen::VectorXf> biases_;
+
+    Eigen::VectorXf input_mean_;
+    Eigen::VectorXf input_scale_;
+    Eigen::VectorXf output_mean_;
+    Eigen::VectorXf output_scale_;
+
+    /** @brief offset of each output in the output layer, -1 if the network does not have it */
+    int offset_L_ = -1;
+    int offset_c_ = -1;
+    int offset_g_ = -1;
+    int offset_J_ = -1;
+    int offset_residual_ = -1;
+
+    /** @brief preallocated buffers of the forward pass, the activations alternate between act_a_ and act_b_ */
+    Eigen::VectorXf input_;
+    Eigen::VectorXf act_a_;
+    Eigen::VectorXf act_b_;
+    Eigen::VectorXf output_;
+    MatrixXd L_;
+};
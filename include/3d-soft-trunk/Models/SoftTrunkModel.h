@@ -26,6 +26,9 @@ public:
      */
     void set_state(const srl::State &state);
 
+    /** @brief update the model's state, and calculate only the jacobians and gravity */
+    void set_kinematics(const srl::State &state);
+
 
     /**
      * @brief get relative pose from base to tip of segment (at the tip of curved sections, ignores connector part)
@@ -0,0 +1,241 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+
+/**
+ * @brief Closed form piecewise constant curvature kinematics of points along the arm, header only.
+ * @details Points are given by their arc length from the base, through the PCC sections and the rigid connectors of each segment.
+ * update() evaluates the pose and position jacobian of all points from q, in either CoordType, without a model update.
+ * The trigonometric functions of all sections and points are evaluated as one batch with Eigen array expressions, which are vectorized with SIMD where Eigen supports it.
+ * Poses are expressed in the frame of the tip transforms of the state (the motion capture frame): the base is rotated by armAngle about y, and each section bends by
+ * \f$ R = I + \frac{\sin\theta}{\theta} [\tilde L]_\times + \frac{1-\cos\theta}{\theta^2} [\tilde L]_\times^2 \f$, \f$ t = l (-\frac{1-\cos\theta}{\theta^2} L_x, -\frac{1-\cos\theta}{\theta^2} L_y, \frac{\sin\theta}{\theta}) \f$
+ * with \f$ \tilde L = (L_y, -L_x, 0) \f$ and \f$ \theta = |L| \f$, where L are the thetax coordinates of the section.
+ */
+class PCCKinematics{
+public:
+    PCCKinematics(const SoftTrunkParameters& st_params) : st_params_(st_params), sections_(st_params.num_segments*st_params.sections_per_segment){
+        assert(st_params_.is_finalized());
+    }
+
+    /** @brief arc length from the base to the end of the connector of segment, i.e. the segment tip */
+    double segment_end(int segment) const {
+        double s = 0;
+        for (int i = 0; i <= segment; i++)
+            s += st_params_.lengths[2*i] + st_params_.lengths[2*i+1];
+        return s;
+    }
+
+    /** @brief set the points to evaluate, by arc length from the base. Arc lengths beyond the tip are clamped to the tip */
+    void set_points(const std::vector<double>& arc_lengths){
+        points_.resize(arc_lengths.size());
+        for (int k = 0; k < arc_lengths.size(); k++){
+            double s = std::max(0., arc_lengths[k]);
+            Point& point = points_[k];
+            point = {sections_ - 1, 1., st_params_.lengths[2*st_params_.num_segments-1]}; // tip
+            for (int i = 0; i < st_params_.num_segments; i++){
+                const double l_sections = st_params_.lengths[2*i];
+                const double l_section = l_sections/st_params_.sections_per_segment;
+                if (s <= l_sections){
+                    int j = std::min((int) (s/l_section), st_params_.sections_per_segment - 1);
+                    point = {i*st_params_.sections_per_segment + j, (s - j*l_section)/l_section, -1};
+                    break;
+                }
+                if (s <= l_sections + st_params_.lengths[2*i+1]){
+                    point = {(i+1)*st_params_.sections_per_segment - 1, 1., s - l_sections};
+                    break;
+                }
+                s -= l_sections + st_params_.lengths[2*i+1];
+            }
+        }
+        positions_.resize(3, points_.size());
+        rotations_.resize(points_.size());
+        jacobians_.resize(points_.size());
+        const int n = sections_ + points_.size();
+        a_.resize(n); b_.resize(n); da_.resize(n); db_.resize(n);
+        Lx_.resize(n); Ly_.resize(n);
+    }
+
+    int num_points() const { return points_.size(); }
+
+    /** @brief evaluate the poses (and position jacobians) of all points at configuration q */
+    void update(const Ref<const VectorXd>& q, bool compute_jacobians = true){
+        assert(q.size() == st_params_.q_size);
+        const int P = st_params_.prismatic;
+
+        // bending angles of the full sections, then of each point's section up to the point
+        ArrayXd cos_phi, sin_phi;
+        if (st_params_.coord_type == CoordType::phitheta){
+            ArrayXd phi(sections_);
+            for (int sec = 0; sec < sections_; sec++)
+                phi(sec) = q(P + 2*sec);
+            cos_phi = phi.cos();
+            sin_phi = phi.sin();
+            for (int sec = 0; sec < sections_; sec++){
+                Lx_(sec) = -cos_phi(sec)*q(P + 2*sec + 1);
+                Ly_(sec) = -sin_phi(sec)*q(P + 2*sec + 1);
+            }
+        } else {
+            for (int sec = 0; sec < sections_; sec++){
+                Lx_(sec) = q(P + 2*sec);
+                Ly_(sec) = q(P + 2*sec + 1);
+            }
+        }
+        for (int k = 0; k < points_.size(); k++){
+            Lx_(sections_ + k) = points_[k].fraction*Lx_(points_[k].section);
+            Ly_(sections_ + k) = points_[k].fraction*Ly_(points_[k].section);
+        }
+        coefficients();
+
+        // chain the full sections. the derivatives of any point p after section sec wrt its bending angles are W (p - o_end) + v
+        const int n_W = compute_jacobians ? 2*sections_ : 0;
+        W_.resize(n_W);
+        v_.resize(n_W);
+        R_start_.resize(sections_);
+        o_start_.resize(sections_);
+        o_end_.resize(sections_);
+        const Matrix3d R_base = AngleAxisd(st_params_.armAngle*PI/180, Vector3d::UnitY()).toRotationMatrix();
+        Matrix3d R_pre = R_base;
+        Vector3d o = P ? Vector3d(q(0)*R_base.col(2)) : Vector3d::Zero();
+        Matrix3d R;
+        Vector3d t;
+        Matrix3d dR[2];
+        Vector3d dt[2];
+        for (int sec = 0; sec < sections_; sec++){
+            const int segment = sec/st_params_.sections_per_segment;
+            const double l = st_params_.lengths[2*segment]/st_params_.sections_per_segment;
+            R_start_[sec] = R_pre;
+            o_start_[sec] = o;
+            section(sec, l, R, t, compute_jacobians ? dR : nullptr, compute_jacobians ? dt : nullptr);
+            if (compute_jacobians){
+                for (int i = 0; i < 2; i++){
+                    W_[2*sec+i] = R_pre*dR[i]*R.transpose()*R_pre.transpose();
+                    v_[2*sec+i] = R_pre*dt[i];
+                }
+            }
+            o += R_pre*t;
+            R_pre = R_pre*R;
+            o_end_[sec] = o;
+            if ((sec + 1) % st_params_.sections_per_segment == 0)
+                o += st_params_.lengths[2*segment+1]*R_pre.col(2); // connector
+        }
+
+        // points
+        for (int k = 0; k < points_.size(); k++){
+            const Point& point = points_[k];
+            const int sec = point.section;
+            const int segment = sec/st_params_.sections_per_segment;
+            const double l = point.fraction*st_params_.lengths[2*segment]/st_params_.sections_per_segment;
+            section(sections_ + k, l, R, t, compute_jacobians ? dR : nullptr, compute_jacobians ? dt : nullptr);
+            rotations_[k] = R_start_[sec]*R;
+            positions_.col(k) = o_start_[sec] + R_start_[sec]*t;
+            if (point.connector >= 0)
+                positions_.col(k) += point.connector*rotations_[k].col(2);
+            if (!compute_jacobians)
+                continue;
+
+            MatrixXd& J = jacobians_[k];
+            J.setZero(3, st_params_.q_size);
+            const Vector3d x = positions_.col(k);
+            const int previous = (point.connector >= 0) ? sec + 1 : sec; // sections which are completely before the point
+            for (int p = 0; p < 2*previous; p++)
+                J.col(P + p) = W_[p]*(x - o_end_[p/2]) + v_[p];
+            if (point.connector < 0){
+                J.col(P + 2*sec) = point.fraction*R_start_[sec]*dt[0];
+                J.col(P + 2*sec + 1) = point.fraction*R_start_[sec]*dt[1];
+            }
+            if (P)
+                J.col(0) = R_base.col(2);
+            if (st_params_.coord_type == CoordType::phitheta){
+                // chain rule from (Lx, Ly) = -theta (cos phi, sin phi) to (phi, theta)
+                for (int s = 0; s <= sec; s++){
+                    const int col = P + 2*s;
+                    const double theta = q(col + 1);
+                    const Vector3d J_Lx = J.col(col);
+                    const Vector3d J_Ly = J.col(col + 1);
+                    J.col(col) = theta*sin_phi(s)*J_Lx - theta*cos_phi(s)*J_Ly;
+                    J.col(col + 1) = -cos_phi(s)*J_Lx - sin_phi(s)*J_Ly;
+                }
+            }
+        }
+    }
+
+    const Matrix3Xd& positions() const { return positions_; }
+    Vector3d position(int k) const { return positions_.col(k); }
+    const Matrix3d& rotation(int k) const { return rotations_[k]; }
+    Affine3d pose(int k) const {
+        Affine3d T = Affine3d::Identity();
+        T.linear() = rotations_[k];
+        T.translation() = positions_.col(k);
+        return T;
+    }
+    /** @brief position jacobian (3 x q_size) of point k, only valid if update() computed jacobians */
+    const MatrixXd& jacobian(int k) const { return jacobians_[k]; }
+
+private:
+    struct Point{
+        /** @brief section the point lies in, or whose end the connector is attached to */
+        int section;
+        /** @brief fraction of the section up to the point */
+        double fraction;
+        /** @brief distance along the connector after the end of the section, -1 if the point lies within the section */
+        double connector;
+    };
+
+    /** @brief coefficients sin(th)/th, (1-cos(th))/th^2 and their derivatives wrt th divided by th, for all entries of Lx_, Ly_ at once. Series expansions near th = 0 */
+    void coefficients(){
+        const ArrayXd th2 = Lx_.square() + Ly_.square();
+        const ArrayXd th = th2.sqrt();
+        const ArrayXd s = th.sin();
+        const ArrayXd c = th.cos();
+        const ArrayXd th2_safe = th2.max(1e-6);
+        const ArrayXd th_safe = th2_safe.sqrt();
+        const auto small = th2 < 1e-6;
+        a_ = small.select(1 - th2/6 + th2.square()/120, s/th_safe);
+        b_ = small.select(0.5 - th2/24 + th2.square()/720, (1 - c)/th2_safe);
+        da_ = small.select(-1./3 + th2/30, (th*c - s)/(th2_safe*th_safe));
+        db_ = small.select(-1./12 + th2/180, (th*s - 2*(1 - c))/th2_safe.square());
+    }
+
+    /** @brief rotation and translation of batch entry i with length l, and optionally their derivatives wrt Lx, Ly */
+    void section(int i, double l, Matrix3d& R, Vector3d& t, Matrix3d* dR, Vector3d* dt) const {
+        const double Lx = Lx_(i);
+        const double Ly = Ly_(i);
+        const double a = a_(i);
+        const double b = b_(i);
+        Matrix3d K;
+        K << 0, 0, -Lx, 0, 0, -Ly, Lx, Ly, 0; // cross product matrix of (Ly, -Lx, 0)
+        const Matrix3d K2 = K*K;
+        R = Matrix3d::Identity() + a*K + b*K2;
+        t = l*Vector3d(-b*Lx, -b*Ly, a);
+        if (!dR)
+            return;
+        const double L[2] = {Lx, Ly};
+        Matrix3d dK[2];
+        dK[0] << 0, 0, -1, 0, 0, 0, 1, 0, 0;
+        dK[1] << 0, 0, 0, 0, 0, -1, 0, 1, 0;
+        for (int j = 0; j < 2; j++){
+            dR[j] = da_(i)*L[j]*K + a*dK[j] + db_(i)*L[j]*K2 + b*(dK[j]*K + K*dK[j]);
+            dt[j] = l*Vector3d(-db_(i)*L[j]*Lx, -db_(i)*L[j]*Ly, da_(i)*L[j]);
+        }
+        dt[0](0) -= l*b;
+        dt[1](1) -= l*b;
+    }
+
+    const SoftTrunkParameters st_params_;
+    const int sections_;
+    std::vector<Point> points_;
+
+    /** @brief batch of bending angles: the full sections followed by the partial section of each point */
+    ArrayXd Lx_, Ly_;
+    ArrayXd a_, b_, da_, db_;
+
+    std::vector<Matrix3d> R_start_;
+    std::vector<Vector3d> o_start_;
+    std::vector<Vector3d> o_end_;
+    std::vector<Matrix3d> W_;
+    std::vector<Vector3d> v_;
+
+    Matrix3Xd positions_;
+    std::vector<Matrix3d> rotations_;
+    std::vector<MatrixXd> jacobians_;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/Identification.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/** @brief K, D and A adapted by ParameterAdaptation. Published as a whole, never modified after publishing */
+struct AdaptedParameters{
+    MatrixXd K;
+    MatrixXd D;
+    MatrixXd A;
+    /** @brief parameters of each segment, see ParameterRegressor */
+    std::vector<VectorXd> theta;
+    /** @brief number of samples used so far */
+    unsigned long int samples = 0;
+};
+
+/**
+ * @brief Online adaptation of the stiffness, damping and actuation matrices during normal operation.
+ * @details Runs recursive least squares with exponential forgetting on the regression form of the dynamics (ParameterRegressor),
+ * i.e. on the model residual B ddq + c + g + K q + D dq - A p.
+ * Samples are queued by add_sample() and processed in a separate thread, so the caller only pays for a copy. The queue is bounded; when it is full the oldest sample is dropped.
+ * The adapted matrices are published atomically through a shared pointer, see parameters().
+ */
+class ParameterAdaptation{
+public:
+    /** @param dyn dynamic parameters of the model to adapt, used as the initial estimate */
+    ParameterAdaptation(const SoftTrunkParameters& st_params, const DynamicParams& dyn);
+
+    ~ParameterAdaptation();
+
+    /** @brief queue a sample for adaptation
+     * @param state measured state, including ddq
+     * @param dyn dynamic parameters at state (only B, c and g are used)
+     * @param p pressure applied at state, in mbar */
+    void add_sample(const srl::State& state, const DynamicParams& dyn, const VectorXd& p);
+
+    /** @brief latest adapted parameters, nullptr until the first update */
+    std::shared_ptr<const AdaptedParameters> parameters() const;
+
+    /** @brief number of samples which were dropped because the queue was full */
+    unsigned long int samples_dropped() const { return samples_dropped_; }
+
+private:
+    struct Sample{
+        srl::State state;
+        /** @brief B ddq + c + g */
+        VectorXd rest;
+        VectorXd p;
+    };
+
+    void adaptation_loop();
+
+    /** @brief one recursive least squares update of the segment with the rows Phi, y */
+    void update(int segment, const MatrixXd& Phi, const VectorXd& y);
+
+    const SoftTrunkParameters st_params_;
+    ParameterRegressor regressor_;
+
+    /** @brief estimate of each segment, scaled by theta_scale_ so all unknowns are of order one */
+    std::vector<VectorXd> theta_;
+    std::vector<MatrixXd> P_;
+    std::vector<VectorXd> theta_scale_;
+    std::vector<VectorXd> theta_initial_;
+    /** @brief covariance of the initial (scaled) estimate, i.e. how quickly it is overridden by measurements */
+    const double initial_covariance_ = 100;
+    /** @brief bounds on the scaled estimate, relative to the initial estimate. Keeps the estimate physical when the excitation is poor */
+    const double max_change_ = 0.8;
+
+    /** @brief the matrices which are published, other entries than those of the segments are kept */
+    DynamicParams dyn_;
+
+    std::shared_ptr<const AdaptedParameters> parameters_;
+    unsigned long int samples_used_ = 0;
+    std::atomic<unsigned long int> samples_dropped_{0};
+
+    std::deque<Sample> queue_;
+    const int max_queue_size_ = 64;
+    std::mutex queue_mtx_;
+    std::condition_variable queue_cv_;
+
+    std::thread adaptation_thread_;
+    bool run_ = true;
+};
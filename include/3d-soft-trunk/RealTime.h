@@ -0,0 +1,60 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include <time.h>
+
+/**
+ * @file RealTime.h
+ * @brief real time scheduling of the loop threads, and a drift free loop timer.
+ * @details SCHED_FIFO priorities and memory locking need CAP_SYS_NICE / CAP_IPC_LOCK (or rtprio / memlock limits in /etc/security/limits.conf).
+ * If they are not granted, a warning is printed and the thread keeps running with the default scheduler.
+ */
+
+/** @brief apply schedule to the calling thread
+ * @param name used in messages
+ * @return false if the priority or affinity could not be set */
+bool apply_schedule(const ThreadSchedule& schedule, const std::string& name);
+
+/** @brief lock all current and future memory of the process in RAM (mlockall)
+ * @return false if not permitted */
+bool lock_memory();
+
+/**
+ * @brief Loop timer with absolute deadlines, as a drop-in replacement for srl::Rate.
+ * @details sleep() waits for the next deadline with clock_nanosleep(TIMER_ABSTIME) on CLOCK_MONOTONIC, so the loop period does not drift with the time spent in the loop.
+ * The last spin_us before the deadline are busy waited, which removes the wakeup latency of the scheduler at the cost of CPU time.
+ * If the loop falls behind by more than a period, the missed deadlines are skipped.
+ * The lateness of each wakeup is recorded, see jitter().
+ */
+class RTRate{
+public:
+    RTRate(double hz, int spin_us = 0);
+
+    /** @brief wait until the next deadline */
+    void sleep();
+
+    struct Jitter{
+        /** @brief lateness of the wakeups after the deadline, in us */
+        double mean_us = 0;
+        double max_us = 0;
+        unsigned long int wakeups = 0;
+        /** @brief number of deadlines which were skipped because the loop fell behind */
+        unsigned long int overruns = 0;
+    };
+
+    /** @brief statistics since construction or the last reset_jitter() */
+    const Jitter& jitter() const { return jitter_; }
+    void reset_jitter();
+
+private:
+    const long long int period_ns_;
+    const long long int spin_ns_;
+    /** @brief next deadline, on CLOCK_MONOTONIC */
+    long long int deadline_ns_;
+    Jitter jitter_;
+    double sum_us_ = 0;
+};
+
+/** @brief run an RTRate at hz for the given number of wakeups on a new thread with schedule, and report the jitter
+ * @details Used at startup to verify that the real time configuration is effective */
+RTRate::Jitter measure_jitter(const ThreadSchedule& schedule, double hz, int spin_us, int wakeups);
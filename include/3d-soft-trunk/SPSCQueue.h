@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free queue for one producer thread and one consumer thread.
+ * @details The slots are allocated once at construction. push() and pop() copy by assignment, so elements whose size does not change (e.g. states of one arm) are passed without allocating.
+ * Neither side ever blocks: push() fails when the queue is full, pop() fails when it is empty.
+ * @tparam T copy assignable element type
+ */
+template <typename T>
+class SPSCQueue{
+public:
+    /** @param capacity maximum number of queued elements
+     * @param blank value every slot is initialized with, e.g. a blank state of the right size */
+    SPSCQueue(int capacity, const T& blank = T()) : slots_(capacity + 1, blank) {}
+
+    /** @brief append a copy of value, only called by the producer
+     * @return false if the queue is full, in which case value is not queued */
+    bool push(const T& value){
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+        if (next == head_.load(std::memory_order_acquire))
+            return false;
+        slots_[tail] = value;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief take the oldest element, only called by the consumer
+     * @return false if the queue is empty, in which case value is not modified */
+    bool pop(T& value){
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        value = slots_[head];
+        head_.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    /** @brief the oldest element without taking it, only called by the consumer
+     * @return nullptr if the queue is empty */
+    const T* front() const {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots_[head];
+    }
+
+    /** @brief approximate number of queued elements, exact only when called from the producer or the consumer while the other is idle */
+    int size() const {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        return (tail + slots_.size() - head) % slots_.size();
+    }
+
+    int capacity() const { return slots_.size() - 1; }
+
+private:
+    size_t increment(size_t i) const { return (i + 1 == slots_.size()) ? 0 : i + 1; }
+
+    /** @brief one slot more than the capacity, so that a full queue can be told apart from an empty one */
+    std::vector<T> slots_;
+    /** @brief next slot to read, written by the consumer. On its own cache line, so the threads do not invalidate each other's index */
+    alignas(64) std::atomic<size_t> head_{0};
+    /** @brief next slot to write, written by the producer */
+    alignas(64) std::atomic<size_t> tail_{0};
+};
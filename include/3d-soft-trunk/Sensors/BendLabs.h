@@ -1,11 +1,17 @@
 #pragma once
 
 #include "3d-soft-trunk/SoftTrunk_common.h"
-#include <mobilerack-interface/SerialInterface.h>
+#include "3d-soft-trunk/SPSCQueue.h"
+#include <atomic>
 
 /** @brief BendLabs sensor reader
  * @details Using following sensor: https://www.bendlabs.com/products/2-axis-soft-flex-sensor/
- * @details This sensor can only read curvature, tip positions must be estimated with forward kinematics */
+ * @details This sensor can only read curvature, tip positions must be estimated with forward kinematics
+ * @details The arduino sends one line of comma separated values per frame, x and y of each sensor it supports (see BendLabs_Arduino), of which the first 2*num_segments are used. The serial port is read by a thread which sleeps in epoll until bytes arrive,
+ * so every frame is stamped on the srl::monotonic_us() clock as soon as its line is received, and the latency is bounded by the serial link instead of a poll period.
+ * Lines which are received together are back-dated by one nominal period per line that follows them, so the timestamps are strictly increasing.
+ * Frames are converted to states on the reader thread and passed to the consumer through a lock-free queue, see pop().
+ * Logging to bendlabs_log.csv happens on a separate thread. */
 class BendLabs{
 public:
 
@@ -13,25 +19,56 @@ public:
 
     ~BendLabs();
 
-    srl::State state_;
-    
+    /** @brief take the oldest frame which was not popped yet, oldest first
+     * @details only one thread may consume frames
+     * @return false if there is no new frame */
+    bool pop(srl::State& state);
+
+    /** @brief frames received since construction, including duplicates */
+    unsigned long int frames_received() const { return frames_received_; }
+    /** @brief frames which were lost: malformed lines, and frames which did not fit into the queue.
+     * The arduino sends no sequence number, and late wakeups of the reader thread look like gaps, so frames lost before the serial port are not counted */
+    unsigned long int frames_dropped() const { return frames_dropped_; }
+    /** @brief frames identical to the previous one. The readings are noisy, so this means the arduino sent the same sample twice. They are not queued */
+    unsigned long int frames_duplicate() const { return frames_duplicate_; }
+
 private:
     SoftTrunkParameters st_params_;
 
-    srl::State state_prev_;
+    /** @brief open the serial port in raw mode, non blocking */
+    void open_port();
+
+    /** @brief parse one line, and queue it if it is a new frame */
+    void process_line(const std::string& line, unsigned long long int timestamp);
 
-    std::unique_ptr<SerialInterface> serialInterface;
+    int fd_ = -1;
+    int epoll_fd_ = -1;
+    /** @brief written by the destructor to wake up the reader thread */
+    int stop_fd_ = -1;
 
+    /** @brief received bytes which do not form a complete line yet */
+    std::string line_;
     std::vector<float> bendLab_data_;
     std::vector<float> bendLab_data_prev_;
+    srl::State state_;
 
-    /** @brief timestamp tracked in us */
-    unsigned long long int timestamp_ = 0;
+    /** @brief nominal interval between frames, in us */
+    unsigned long long int period_;
+    /** @brief timestamp of the previous line, in us */
     unsigned long long int last_timestamp_ = 0;
 
-    std::thread calculatorThread;
-    void calculator_loop();
+    SPSCQueue<srl::State> queue_;
+    SPSCQueue<srl::State> log_queue_;
+
+    std::atomic<unsigned long int> frames_received_{0};
+    std::atomic<unsigned long int> frames_dropped_{0};
+    std::atomic<unsigned long int> frames_duplicate_{0};
+
+    std::thread readerThread;
+    void reader_loop();
+
+    std::thread logThread;
+    void log_loop();
 
-    std::mutex mtx;
-    bool run = true;
-};
\ No newline at end of file
+    std::atomic<bool> run{true};
+};
@@ -1,11 +1,17 @@
 #pragma once
 
 #include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/SPSCQueue.h"
+#include "3d-soft-trunk/TripleBuffer.h"
 #include <mobilerack-interface/QualisysClient.h>
+#include <atomic>
+#include <functional>
 
 /** @brief Motion Capture sensor.
  * @details SRL uses a Qualisys motion capture system. This object uses their API to read frames by number
- * @details The frames must be numbered accordingly in the Qualisys Software. 0 for base (top) frame. */
+ * @details The frames must be numbered accordingly in the Qualisys Software. 0 for base (top) frame.
+ * @details Every new QTM frame is converted to a state on the acquisition thread, in buffers allocated at construction, and published as a wait-free snapshot (see latest()), so readers never wait for the conversion.
+ * Occluded bodies are handled one by one: if an object is not visible, its last seen transform is kept and the arm state is still published. Only frames in which a body of the arm is missing are dropped. */
 class MotionCapture{
 public:
     MotionCapture(const SoftTrunkParameters& st_params);
@@ -16,26 +22,80 @@ public:
      * @param id number of the frame to grab
      * @details This function is for debugging purposes */
     Eigen::Transform<double, 3, Eigen::Affine> get_frame(int id);
-    
-    SoftTrunkParameters st_params_;
 
-    srl::State state_;
+    /** @brief copy the newest state into state, only one thread may read states
+     * @return false if no new frame arrived since the last call, in which case state is not modified */
+    bool latest(srl::State& state);
+
+    /** @brief call callback with every new state, on the acquisition thread. It must return quickly, as the next frame is not processed before.
+     * @param callback replaces the previous callback, nullptr to remove it */
+    void set_callback(std::function<void(const srl::State&)> callback);
+
+    /** @brief QTM frames received since construction */
+    unsigned long int frames_received() const { return frames_received_; }
+    /** @brief frames which were dropped because a body of the arm was not visible */
+    unsigned long int frames_dropped() const { return frames_dropped_; }
+    /** @brief frames which were published although at least one object was not visible */
+    unsigned long int frames_partial() const { return frames_partial_; }
 
+    SoftTrunkParameters st_params_;
 
 private:
- 
+
+    /** @brief convert abs_transforms_ into state_
+     * @return false if the arm is not fully visible */
+    bool process_frame();
+
     /** @brief the connection to QTM server */
     std::unique_ptr<QualisysClient> optiTrackClient;
     /** @brief Absolute qualisys tranformations */
     std::vector<Eigen::Transform<double, 3, Eigen::Affine>> abs_transforms_;
 
+    /** @brief newest state, only used by the acquisition thread */
+    srl::State state_;
+    /** @brief configuration and velocity of the current frame, before they replace those of the previous frame in state_ */
+    VectorXd q_;
+    VectorXd dq_;
+    /** @brief last seen transforms of the objects */
+    decltype(srl::State::objects) objects_;
+
+    /** @brief rotation of the QTM frame into the base frame, and of each body into the desired orientation */
+    Matrix3d base_rotation_;
+    Matrix3d body_rotation_;
+
+    TripleBuffer<srl::State> snapshot_;
+    SPSCQueue<srl::State> log_queue_;
+
+    std::function<void(const srl::State&)> callback_;
+    std::mutex callback_mtx_;
+
+    /** @brief timestamp of QTM, in us */
     unsigned long long int timestamp_ = 0;
     unsigned long long int last_timestamp_ = 0;
 
+    /** @brief offset from the QTM clock to the srl::monotonic_us() clock, in us
+     * @details estimated as the smallest difference between the arrival time and the QTM timestamp over the last clock_window_ seconds, i.e. the offset for the frame with the least transport delay.
+     * Frames older than the window are forgotten, so that the offset follows a drift between the two clocks instead of keeping the error it builds up */
+    long long int clock_offset_ = 0;
+    static constexpr double clock_window_ = 2.;
+    /** @brief candidates for the smallest offset in the window as (arrival time, offset), both increasing. A ring buffer allocated before the first frame */
+    std::vector<std::pair<unsigned long long int, long long int>> offset_window_;
+    int window_start_ = 0;
+    int window_count_ = 0;
+
+    /** @brief add the offset of a frame which arrived at now, and update clock_offset_ to the smallest offset in the window */
+    void update_clock_offset(unsigned long long int now, long long int offset);
+
+    std::atomic<unsigned long int> frames_received_{0};
+    std::atomic<unsigned long int> frames_dropped_{0};
+    std::atomic<unsigned long int> frames_partial_{0};
+
     std::thread calculatorThread;
     void calculator_loop();
 
-    std::mutex mtx;
-    bool run_ = true;
+    std::thread logThread;
+    void log_loop();
+
+    std::atomic<bool> run_{true};
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/Model.h"
+#include "3d-soft-trunk/PCCKinematics.h"
+#include "3d-soft-trunk/SPSCQueue.h"
+#include "3d-soft-trunk/TripleBuffer.h"
+#include "3d-soft-trunk/RealTime.h"
+#include <atomic>
+#include <random>
+
+/** @brief Simulated sensor, to run the real sensor, model and control threads without the rig.
+ * @details A physics thread integrates the model forward in real time under the pressure set with set_pressure(), like the arm would move under the valves.
+ * At sensor_refresh_rate it samples the state, with the imperfections of st_params.simulated_sensor: gaussian noise and quantization of q, lost samples,
+ * and a latency before the sample is delivered. dq and ddq are differentiated from the delivered q, and the tip transforms are computed from it with PCCKinematics, as if measured by the motion capture.
+ * Samples are published as wait-free snapshots like MotionCapture, see latest(). */
+class SimulatedSensor{
+public:
+    SimulatedSensor(const SoftTrunkParameters& st_params);
+
+    ~SimulatedSensor();
+
+    /** @brief copy the newest delivered state into state, only one thread may read states
+     * @return false if no new sample was delivered since the last call, in which case state is not modified */
+    bool latest(srl::State& state);
+
+    /** @brief pressure applied to the simulated arm from now on, in mbar (size: p_size). Only one thread may set it */
+    void set_pressure(const VectorXd& p);
+
+    /** @brief true state of the simulated arm, without any imperfections */
+    srl::State ground_truth();
+
+    /** @brief samples taken, and samples which were lost on purpose (dropout) */
+    unsigned long int samples_taken() const { return samples_taken_; }
+    unsigned long int samples_dropped() const { return samples_dropped_; }
+
+    /** @brief rate at which the model is integrated, in hz */
+    const double physics_rate_ = 1000.;
+
+private:
+    void physics_loop();
+
+    /** @brief integrate truth_ by h seconds with the current pressure */
+    void integrate(double h);
+
+    /** @brief measure truth_ at time t, and queue the sample for delivery */
+    void sample(unsigned long long int t);
+
+    /** @brief differentiate and complete a delivered sample, then publish it */
+    void deliver(const srl::State& measured);
+
+    const SoftTrunkParameters st_params_;
+    const SimulatedSensorConfig config_;
+
+    std::unique_ptr<Model> mdl_;
+    PCCKinematics kinematics_;
+
+    srl::State truth_;
+    std::mutex truth_mtx_;
+    VectorXd p_;
+    TripleBuffer<VectorXd> pressure_;
+
+    /** @brief measured samples which are waiting for their latency to pass */
+    SPSCQueue<srl::State> in_flight_;
+    srl::State measured_;
+    /** @brief the delivered state, and the one delivered before */
+    srl::State state_;
+    srl::State state_prev_;
+    TripleBuffer<srl::State> snapshot_;
+
+    std::mt19937 random_;
+    std::normal_distribution<double> noise_{0., 1.};
+    std::uniform_real_distribution<double> uniform_{0., 1.};
+
+    std::atomic<unsigned long int> samples_taken_{0};
+    std::atomic<unsigned long int> samples_dropped_{0};
+
+    std::thread physicsThread;
+    std::atomic<bool> run_{true};
+};
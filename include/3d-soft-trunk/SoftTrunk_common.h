@@ -17,6 +17,8 @@
 #include <mutex>
 #include <cmath>
 #include <fstream>
+#include <chrono>
+#include <stdexcept>
 
 
 using namespace Eigen;
@@ -39,6 +41,8 @@ enum class ModelType {
     augmentedrigidarm, 
     /** @brief uses lagrangian dynamics to derive equation of motion */
     lagrange,
+    /** @brief evaluates a small trained network, see NeuralModel */
+    neural,
 };
 
 enum class CoordType {
@@ -55,31 +59,106 @@ enum class SensorType {
     bendlabs,
     /** @brief simulate to obtain states */
     simulator,
+    /** @brief simulated sensor, integrates the model on its own thread and delivers states through the StateEstimator like a real sensor */
+    simulated,
 };
 
 enum class FilterType {
     none,
 };
 
+/** @brief Scheduling of one of the loop threads, see RealTime.h */
+struct ThreadSchedule {
+    /** @brief SCHED_FIFO priority (1-99), 0 keeps the default scheduler */
+    int priority = 0;
+    /** @brief CPUs the thread may run on, empty for all */
+    std::vector<int> cpus;
+};
+
+/** @brief Imperfections of the simulated sensor, see SimulatedSensor */
+struct SimulatedSensorConfig {
+    /** @brief standard deviation of the gaussian noise added to q */
+    double noise = 0;
+    /** @brief time from measurement until the state is delivered, in s */
+    double latency = 0;
+    /** @brief probability that a sample is lost */
+    double dropout = 0;
+    /** @brief resolution of q, 0 for none */
+    double quantization = 0;
+    /** @brief seed of the noise and dropout */
+    unsigned int seed = 0;
+};
+
+/** @brief capacities of the state, set when configuring cmake. States of any configuration up to these sizes are stored inline, without heap allocations
+ * @details q_size = 2*num_segments*sections_per_segment+prismatic must be at most SOFTTRUNK_MAX_Q_SIZE, num_segments+1+prismatic at most SOFTTRUNK_MAX_FRAMES */
+#ifndef SOFTTRUNK_MAX_Q_SIZE
+#define SOFTTRUNK_MAX_Q_SIZE 32
+#endif
+#ifndef SOFTTRUNK_MAX_FRAMES
+#define SOFTTRUNK_MAX_FRAMES 8
+#endif
+#ifndef SOFTTRUNK_MAX_OBJECTS
+#define SOFTTRUNK_MAX_OBJECTS 8
+#endif
+
 namespace srl{
+    /** @brief vector of up to SOFTTRUNK_MAX_Q_SIZE elements, stored inline. Converts to and from VectorXd */
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, SOFTTRUNK_MAX_Q_SIZE, 1> StateVector;
+
+    /** @brief std::vector-like container of up to N elements, stored inline so copying it never allocates */
+    template <typename T, int N>
+    class FixedVector{
+    public:
+        FixedVector(int size = 0){ resize(size); }
+
+        /** @throws std::length_error if size is larger than the capacity N */
+        void resize(int size){
+            if (size < 0 || size > N)
+                throw std::length_error(fmt::format("FixedVector: size {} is outside of the capacity {}", size, N));
+            size_ = size;
+        }
+        int size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        T& operator[](int i){ return data_[i]; }
+        const T& operator[](int i) const { return data_[i]; }
+        T& back(){ return data_[size_-1]; }
+        const T& back() const { return data_[size_-1]; }
+        T* begin(){ return data_.data(); }
+        T* end(){ return data_.data() + size_; }
+        const T* begin() const { return data_.data(); }
+        const T* end() const { return data_.data() + size_; }
+
+    private:
+        std::array<T, N> data_;
+        int size_ = 0;
+    };
+
+    /** @brief current time of the monotonic clock in us. All sensor timestamps are expressed on this clock, so that states from different sensors can be compared. */
+    inline unsigned long long int monotonic_us(){
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     /**
      * @brief represents the position \f$q\f$, velocity \f$\dot q\f$, and acceleration \f$\ddot q\f$ for the soft arm.
+     * @details All members are stored inline with a fixed capacity (see SOFTTRUNK_MAX_Q_SIZE), so states are copied from the sensors to the controller without any heap allocation.
      */
     class State{
     public:
         /** @brief joint configuration */
-        VectorXd q;
+        StateVector q;
         /** @brief joint velocity */
-        VectorXd dq;
+        StateVector dq;
         /** @brief joint acceleration */
-        VectorXd ddq;
+        StateVector ddq;
         /** @brief tip transformations relative to base segment */
-        std::vector<Eigen::Transform<double, 3, Eigen::Affine>> tip_transforms;
+        FixedVector<Eigen::Transform<double, 3, Eigen::Affine>, SOFTTRUNK_MAX_FRAMES> tip_transforms;
         /** @brief object transformations relative to base segment */
-        std::vector<Eigen::Transform<double, 3, Eigen::Affine>> objects;
+        FixedVector<Eigen::Transform<double, 3, Eigen::Affine>, SOFTTRUNK_MAX_OBJECTS> objects;
 
         CoordType coordtype;
-        unsigned long long int timestamp;
+        /** @brief time at which the state was measured, in us on the srl::monotonic_us() clock */
+        unsigned long long int timestamp = 0;
 
         /** @brief initialize and set the size of the vectors at the same time. */
         State(CoordType coordtype, const int q_size) : coordtype(coordtype){
@@ -92,8 +171,11 @@ namespace srl{
         State(){
         }
 
-        /** @brief designate size of state (i.e. degrees of freedom) */
+        /** @brief designate size of state (i.e. degrees of freedom)
+         * @throws std::length_error if q_size is larger than SOFTTRUNK_MAX_Q_SIZE */
         void setSize(const int q_size){
+            if (q_size > SOFTTRUNK_MAX_Q_SIZE)
+                throw std::length_error(fmt::format("srl::State: q size {} exceeds SOFTTRUNK_MAX_Q_SIZE = {}", q_size, SOFTTRUNK_MAX_Q_SIZE));
             q = VectorXd::Zero(q_size);
             dq = VectorXd::Zero(q_size);
             ddq = VectorXd::Zero(q_size);
@@ -127,6 +209,10 @@ struct DynamicParams{
     std::vector<MatrixXd> dJ;
     /** @brief Vector containing forward kinematic positions of all segment tips */
     std::vector<Vector3d> x;
+    /** @brief timestamp of the state J, g and x were computed at, in us on the srl::monotonic_us() clock */
+    unsigned long long int kinematics_timestamp = 0;
+    /** @brief timestamp of the state B, c and S were computed at, in us on the srl::monotonic_us() clock */
+    unsigned long long int dynamics_timestamp = 0;
 };
 
 /**
@@ -186,6 +272,9 @@ public:
     /** @brief Model used to derive the parameters of the dynamic equation */
     ModelType model_type = ModelType::augmentedrigidarm;
 
+    /** @brief Weights of the network of ModelType::neural, relative to the config folder */
+    std::string neural_weights = "";
+
     /** @brief Coordinate parametrization of all variables */
     CoordType coord_type = CoordType::thetax;
 
@@ -212,12 +301,36 @@ public:
     /** @brief Speed at which model self-updates, given in hz */
     double model_update_rate = 100.;
 
+    /** @brief If nonzero, the jacobians and gravity are updated on the control thread on every control tick, and the model loop only refreshes the inertia and coriolis terms at this rate (in hz) instead of model_update_rate */
+    double dynamics_update_rate = 0;
+
+    /** @brief The model reuses its results if no element of q (dq) changed by more than this since the states they were computed at. 0 only reuses them for an unchanged state */
+    double model_q_threshold = 0;
+    double model_dq_threshold = 0;
+
     /** @brief Controller refresh rate in hz */
     double controller_update_rate = 50;
 
     /** @brief Serial address of the BendLabs sensors (if using) */
     std::string bendlabs_address = "/dev/ttyACM0";
 
+    /** @brief IP address of the valve controller (Modbus TCP) */
+    std::string valve_address = "192.168.0.100";
+
+    /** @brief Imperfections of SensorType::simulated */
+    SimulatedSensorConfig simulated_sensor;
+
+    /** @brief Scheduling of the control, model and sensor threads */
+    ThreadSchedule control_schedule;
+    ThreadSchedule model_schedule;
+    ThreadSchedule sensor_schedule;
+
+    /** @brief Lock all current and future memory of the process in RAM, so the loops never wait for page faults */
+    bool lock_memory = false;
+
+    /** @brief The loop timers sleep until this many us before the deadline, and busy wait for the rest. Trades CPU time for lower jitter */
+    int timer_spin_us = 0;
+
     /** @brief Size of the pseudo pressure vector
      * @details The pseudo-pressure vector is of same size as q_size, to avoid underaction. You can transform back to "real" pressure with Model::pseudo2real */
     int p_pseudo_size;
@@ -231,6 +344,18 @@ public:
     /** @brief Maximal pressure for the valve controller */
     int p_max = 650;
 
+    /** @brief Chamber pressures which changed by this amount or less (in mbar) since the last command are not resent to the valves. 0 only suppresses unchanged values. */
+    int valve_change_threshold = 0;
+
+    /** @brief Forward integrate the measured state to the expected actuation time before running the control law, to compensate for the latency of the pipeline */
+    bool latency_compensation = false;
+
+    /** @brief Adapt K, D and A online with recursive least squares on the model residual (see ParameterAdaptation) */
+    bool parameter_adaptation = false;
+
+    /** @brief Forgetting factor of the parameter adaptation per sample, 1 never forgets */
+    double adaptation_forgetting = 0.999;
+
     /** @brief Coefficients for an angular offset polynomial. currently not used. */
     std::vector<double> angOffsetCoeffs = {0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0};
 
@@ -251,6 +376,14 @@ public:
         p_size = 3*num_segments+2*prismatic+1;
         q_size = 2*num_segments*sections_per_segment+prismatic;
         p_pseudo_size = q_size;
+        // the state is stored inline, with a capacity set when configuring cmake. Checked in release builds too, since exceeding it would corrupt memory
+        if (q_size > SOFTTRUNK_MAX_Q_SIZE)
+            throw std::length_error(fmt::format("q size {} exceeds SOFTTRUNK_MAX_Q_SIZE = {}, reconfigure with cmake -DSOFTTRUNK_MAX_Q_SIZE={}", q_size, SOFTTRUNK_MAX_Q_SIZE, q_size));
+        if (num_segments + 1 + prismatic > SOFTTRUNK_MAX_FRAMES)
+            throw std::length_error(fmt::format("{} tip transforms exceed SOFTTRUNK_MAX_FRAMES = {}, reconfigure with cmake -DSOFTTRUNK_MAX_FRAMES={}", num_segments + 1 + prismatic, SOFTTRUNK_MAX_FRAMES, num_segments + 1 + prismatic));
+        if (objects > SOFTTRUNK_MAX_OBJECTS)
+            throw std::length_error(fmt::format("{} objects exceed SOFTTRUNK_MAX_OBJECTS = {}, reconfigure with cmake -DSOFTTRUNK_MAX_OBJECTS={}", objects, SOFTTRUNK_MAX_OBJECTS, objects));
+        assert(model_type != ModelType::neural || !neural_weights.empty());
         finalized = true;
     }
 
@@ -277,6 +410,55 @@ public:
     this->chamberConfigs = params["chamberConfigs"].as<std::vector<double>>();
     this->p_max = params["p_max"].as<int>();
     this->prismatic = params["prismatic"].as<bool>();
+    // optional parameters, older YAML files may not contain them
+    if (params["valve change threshold"])
+        this->valve_change_threshold = params["valve change threshold"].as<int>();
+    if (params["latency compensation"])
+        this->latency_compensation = params["latency compensation"].as<bool>();
+    if (params["parameter adaptation"])
+        this->parameter_adaptation = params["parameter adaptation"].as<bool>();
+    if (params["adaptation forgetting"])
+        this->adaptation_forgetting = params["adaptation forgetting"].as<double>();
+    if (params["valve address"])
+        this->valve_address = params["valve address"].as<std::string>();
+    if (params["dynamics update rate"])
+        this->dynamics_update_rate = params["dynamics update rate"].as<double>();
+    if (params["model q threshold"])
+        this->model_q_threshold = params["model q threshold"].as<double>();
+    if (params["model dq threshold"])
+        this->model_dq_threshold = params["model dq threshold"].as<double>();
+    if (params["real time"]){
+        YAML::Node rt = params["real time"];
+        if (rt["lock memory"])
+            this->lock_memory = rt["lock memory"].as<bool>();
+        if (rt["timer spin"])
+            this->timer_spin_us = rt["timer spin"].as<int>();
+        auto read_schedule = [&](const std::string& name, ThreadSchedule& schedule){
+            if (!rt[name])
+                return;
+            if (rt[name]["priority"])
+                schedule.priority = rt[name]["priority"].as<int>();
+            if (rt[name]["cpus"])
+                schedule.cpus = rt[name]["cpus"].as<std::vector<int>>();
+        };
+        read_schedule("control", this->control_schedule);
+        read_schedule("model", this->model_schedule);
+        read_schedule("sensor", this->sensor_schedule);
+    }
+
+    if (params["simulated sensor"]){
+        YAML::Node sim = params["simulated sensor"];
+        if (sim["noise"])
+            this->simulated_sensor.noise = sim["noise"].as<double>();
+        if (sim["latency"])
+            this->simulated_sensor.latency = sim["latency"].as<double>();
+        if (sim["dropout"])
+            this->simulated_sensor.dropout = sim["dropout"].as<double>();
+        if (sim["quantization"])
+            this->simulated_sensor.quantization = sim["quantization"].as<double>();
+        if (sim["seed"])
+            this->simulated_sensor.seed = sim["seed"].as<unsigned int>();
+    }
 
     std::vector<std::string> sensor_vec = params["sensors"].as<std::vector<std::string>>();
     this->sensors.clear();
@@ -293,6 +475,10 @@ public:
             sensors.push_back(SensorType::simulator);
             continue;
         }
+        if (sensor_vec[i]=="simulated"){
+            sensors.push_back(SensorType::simulated);
+            continue;
+        }
         fmt::print("Error reading sensors from YAML!\n");
         assert(false);
     }
@@ -302,10 +488,14 @@ public:
         model_type = ModelType::augmentedrigidarm;
     } else if (modeltype == "lagrange"){
         model_type = ModelType::lagrange;
+    } else if (modeltype == "neural"){
+        model_type = ModelType::neural;
     } else {
         fmt::print("Error reading model type from YAML!\n");
         assert(false);
     }
+    if (params["neural weights"])
+        this->neural_weights = params["neural weights"].as<std::string>();
     std::string coordtype = params["coord_type"].as<std::string>();
     if (coordtype == "thetax"){
         coord_type = CoordType::thetax;
@@ -345,11 +535,34 @@ public:
     params["valvemap"].SetStyle(YAML::EmitterStyle::Flow);  
     params["sensor refresh rate"] = this->sensor_refresh_rate;
     params["bendlabs address"] = this->bendlabs_address;
+    params["valve address"] = this->valve_address;
     params["model update rate"] = this->model_update_rate;
+    params["dynamics update rate"] = this->dynamics_update_rate;
+    params["model q threshold"] = this->model_q_threshold;
+    params["model dq threshold"] = this->model_dq_threshold;
     params["chamberConfigs"] = this->chamberConfigs;
     params["chamberConfigs"].SetStyle(YAML::EmitterStyle::Flow);
     params["p_max"] = this->p_max;
     params["prismatic"] = this->prismatic;
+    params["valve change threshold"] = this->valve_change_threshold;
+    params["latency compensation"] = this->latency_compensation;
+    params["parameter adaptation"] = this->parameter_adaptation;
+    params["adaptation forgetting"] = this->adaptation_forgetting;
+    params["real time"]["lock memory"] = this->lock_memory;
+    params["real time"]["timer spin"] = this->timer_spin_us;
+    auto write_schedule = [&](const std::string& name, const ThreadSchedule& schedule){
+        params["real time"][name]["priority"] = schedule.priority;
+        params["real time"][name]["cpus"] = schedule.cpus;
+        params["real time"][name]["cpus"].SetStyle(YAML::EmitterStyle::Flow);
+    };
+    write_schedule("control", this->control_schedule);
+    write_schedule("model", this->model_schedule);
+    write_schedule("sensor", this->sensor_schedule);
+    params["simulated sensor"]["noise"] = this->simulated_sensor.noise;
+    params["simulated sensor"]["latency"] = this->simulated_sensor.latency;
+    params["simulated sensor"]["dropout"] = this->simulated_sensor.dropout;
+    params["simulated sensor"]["quantization"] = this->simulated_sensor.quantization;
+    params["simulated sensor"]["seed"] = this->simulated_sensor.seed;
     std::vector<std::string> sensor_vec;
     for (int i = 0; i < this->sensors.size(); i++){
         if (sensors[i]==SensorType::qualisys){
@@ -364,6 +577,10 @@ public:
             sensor_vec.push_back("simulator");
             continue;
         }
+        if (sensors[i]==SensorType::simulated){
+            sensor_vec.push_back("simulated");
+            continue;
+        }
         assert(false);
     }
     params["sensors"] = sensor_vec;
@@ -374,10 +591,14 @@ public:
         model = "augmented";
     } else if (this->model_type == ModelType::lagrange){
         model = "lagrange";
+    } else if (this->model_type == ModelType::neural){
+        model = "neural";
     } else {
         assert(false);
     }
     params["model type"] = model;
+    if (!this->neural_weights.empty())
+        params["neural weights"] = this->neural_weights;
 
     std::ofstream out(loc);
     out << "---\n";
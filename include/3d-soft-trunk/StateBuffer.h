@@ -0,0 +1,61 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+
+/** @brief Time-indexed ring buffer of states coming from a single sensor.
+ * @details All timestamps are in us on the srl::monotonic_us() clock. The buffer can be queried at arbitrary times with state_at(),
+ * which interpolates between the two neighbouring samples, or extrapolates from the newest sample if the requested time lies in the future.
+ * This allows sensors running at different rates (e.g. Qualisys at 500Hz, BendLabs at 100Hz) to be compared on one time base. */
+class StateBuffer{
+public:
+    /** @param capacity number of samples kept in the buffer, older samples are overwritten */
+    StateBuffer(const SoftTrunkParameters& st_params, int capacity = 256);
+
+    /** @brief add a new sample to the buffer.
+     * @return false if the sample is not newer than the newest sample in the buffer, in which case it is ignored */
+    bool push(const srl::State& state);
+
+    /** @brief get the state at time t
+     * @details interpolates linearly between samples (rotations are interpolated with slerp).
+     * If t is newer than the newest sample, the state is extrapolated with its velocity and acceleration, for at most max_extrapolation_ seconds.
+     * If t is older than the oldest sample, the oldest sample is returned.
+     * @param t time in us
+     * @return false if the buffer is empty */
+    bool state_at(unsigned long long int t, srl::State& state) const;
+
+    /** @brief get the newest sample
+     * @return false if the buffer is empty */
+    bool latest(srl::State& state) const;
+
+    /** @brief timestamp of the newest sample, 0 if empty */
+    unsigned long long int newest_timestamp() const;
+
+    /** @brief timestamp of the oldest sample, 0 if empty */
+    unsigned long long int oldest_timestamp() const;
+
+    int size() const;
+
+    void clear();
+
+    /** @brief maximum time to extrapolate past the newest sample, in s */
+    double max_extrapolation_ = 0.05;
+
+private:
+    const SoftTrunkParameters st_params_;
+
+    std::vector<srl::State> buffer_;
+    /** @brief index at which the next sample will be written */
+    int head_ = 0;
+    int count_ = 0;
+
+    /** @brief get the i-th oldest sample */
+    const srl::State& at(int i) const;
+
+    /** @brief interpolate between a and b, with ratio 0 <= r <= 1 */
+    void interpolate(const srl::State& a, const srl::State& b, double r, srl::State& state) const;
+
+    /** @brief extrapolate state a forward by dt seconds */
+    void extrapolate(const srl::State& a, double dt, srl::State& state) const;
+
+    mutable std::mutex mtx;
+};
@@ -3,6 +3,8 @@
 #include "3d-soft-trunk/SoftTrunk_common.h"
 #include "3d-soft-trunk/Sensors/BendLabs.h"
 #include "3d-soft-trunk/Sensors/MotionCapture.h"
+#include "3d-soft-trunk/Sensors/SimulatedSensor.h"
+#include "3d-soft-trunk/StateBuffer.h"
 
 /** @brief The StateEstimator object polls any number of sensors to obtain states. It also has functionality to filter states, although so far no filters have been implemented*/
 class StateEstimator{
@@ -14,13 +16,25 @@ public:
     /** @brief Fetch new state data from all sensors, and filter them. */
     void poll_sensors();
 
+    /** @brief Get the state of one sensor at an arbitrary time, interpolated / extrapolated from its buffered samples
+     * @param t time in us, on the srl::monotonic_us() clock
+     * @param sensor index of the sensor, in the order of st_params.sensors
+     * @return false if the sensor has not delivered any samples yet */
+    bool state_at(unsigned long long int t, srl::State& state, int sensor = 0);
+
     /** @brief The clean, filtered state */
     srl::State state_;
     
-    /** @brief Raw sensor data from all sensors. Unfiltered. */
+    /** @brief Raw sensor data from all sensors, aligned to the same timestamp. Unfiltered. */
     std::vector<srl::State> all_states_;
 
+    /** @brief Time-indexed history of each sensor's samples */
+    std::vector<std::unique_ptr<StateBuffer>> buffers_;
+
     const SoftTrunkParameters st_params_;
+
+    /** @brief the simulated sensor, to apply pressures to it. nullptr if it is not used */
+    SimulatedSensor* simulated_sensor() const { return simulated_.get(); }
 private:
 
     /** @brief vector containing all active sensors */
@@ -28,8 +42,9 @@ private:
 
     std::unique_ptr<MotionCapture> mocap_;
     std::unique_ptr<BendLabs> bendlabs_;
+    std::unique_ptr<SimulatedSensor> simulated_;
 
-    /** @brief Grab newest states of sensors */
+    /** @brief Grab newest states of sensors, buffer them and align them to the newest timestamp among all sensors */
     void get_states();
 
     /** @brief Update the filtered state according to filter*/
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+
+/**
+ * @brief Task space linear algebra of a 3xn jacobian, shared by the task space controllers.
+ * @details update() factors the 3x3 matrix J J^T (and J B^-1 J^T if B is given) with a symmetric eigendecomposition, once per control tick.
+ * The damped pseudoinverse, operational space inertia and singularity measure are all computed from these factorizations,
+ * instead of running an SVD of the 3xn jacobian for each of them.
+ */
+class TaskSpace{
+public:
+    /** @brief factor J J^T */
+    void update(const MatrixXd& J);
+
+    /** @brief factor J J^T and J B^-1 J^T
+     * @param B inertia matrix (size q_size x q_size) */
+    void update(const MatrixXd& J, const MatrixXd& B);
+
+    /** @brief damped pseudoinverse of J, with damping that fades in when a singular value drops below e
+     * @details Deo, A. S., & Walker, I. D. (1995). Overview of damped least-squares methods for inverse kinematics of robot manipulators.
+     * @param e singular value below which damping is applied
+     * @param lambda damping factor at a singular value of 0 */
+    MatrixXd damped_pinv(double e, double lambda) const;
+
+    /** @brief operational space inertia matrix (J B^-1 J^T)^-1. Requires update() with B */
+    const Matrix3d& operational_inertia() const;
+
+    /** @brief continuous singularity measure, smallest over largest singular value of J. 0 in a singularity, 1 if isotropic
+     * @details directions which cannot be spanned by J in any configuration (J with fewer than 3 columns) are not counted */
+    double singularity_measure() const;
+
+private:
+    MatrixXd J_;
+    /** @brief eigendecomposition of J J^T, eigenvalues in increasing order */
+    Vector3d eigenvalues_;
+    Matrix3d eigenvectors_;
+    /** @brief LDLT of B, and B^-1 J^T */
+    LDLT<MatrixXd> B_ldlt_;
+    MatrixXd B_inv_JT_;
+    Matrix3d operational_inertia_;
+    bool has_inertia_ = false;
+};
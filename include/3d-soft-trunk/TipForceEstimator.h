@@ -0,0 +1,57 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+
+/**
+ * @brief Estimates the external force on the tip of the arm from the residual of the dynamic model.
+ * @details With an external force f on the tip, the dynamics are \f$ B \ddot q + c + g + K q + D \dot q = A p + J^T f \f$, so the residual
+ * \f$ \tau_{res} = B \ddot q + c + g + K q + D \dot q - A p \f$ is explained by \f$ J^T f \f$.
+ * Every update solves the regularized least squares problem \f$ \min_f \|J^T f - \tau_{res}\|^2 + \lambda \|f - f_{prev}\|^2 \f$ in closed form,
+ * \f$ f = (J J^T + \lambda I)^{-1} (J \tau_{res} + \lambda f_{prev}) \f$. The system is 3x3, so an update costs a few matrix-vector products and does not allocate.
+ * Warm starting from the previous estimate smooths the noise of ddq, and keeps the estimate defined when the arm is straight and J loses rank.
+ *
+ * Model errors also show up in the residual. tare() averages the residual over a few updates while no force is applied, and subtracts it from then on.
+ */
+class TipForceEstimator{
+public:
+    TipForceEstimator(const SoftTrunkParameters& st_params);
+
+    /** @brief update the estimate with a new measurement
+     * @param state measured state, including ddq
+     * @param dyn dynamic parameters at state
+     * @param p pressure applied at state, in mbar (size: p_size)
+     * @return the new estimate, see force() */
+    const Vector3d& update(const srl::State& state, const DynamicParams& dyn, const VectorXd& p);
+
+    /** @brief estimated force on the tip by the environment, in N, in the base frame. A load of m kg hanging from the tip gives (0, 0, -9.81 m) */
+    const Vector3d& force() const { return f_; }
+
+    /** @brief average the residual of the next samples updates as the offset of no external force, e.g. after attaching the gripper */
+    void tare(int samples = 50);
+
+    /** @brief true while tare() is still averaging */
+    bool taring() const { return tare_remaining_ > 0; }
+
+    /** @brief forget the estimate and the offset */
+    void reset();
+
+    /** @brief weight of the previous estimate relative to \f$ J J^T \f$ (in m^2), larger values smooth more and follow changes slower */
+    double regularization_ = 1e-3;
+
+    /** @brief include \f$ B \ddot q \f$ in the residual. Without it the estimate is quasi-static, which is less noisy if ddq is poorly measured */
+    bool inertial_ = true;
+
+    /** @brief index of the jacobian in DynamicParams::J the force acts on, the tip by default */
+    int segment_;
+
+private:
+    const SoftTrunkParameters st_params_;
+
+    Vector3d f_ = Vector3d::Zero();
+    /** @brief residual torque of the current update, and the offset subtracted from it */
+    VectorXd tau_res_;
+    VectorXd tau_offset_;
+    VectorXd tare_sum_;
+    int tare_remaining_ = 0;
+    int tare_samples_ = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include <deque>
+#include <mutex>
+
+/**
+ * @brief Streaming task space trajectory generator.
+ * @details Waypoints are queued from any thread with add_waypoint(), and step() is evaluated by the control thread at its rate.
+ * Consecutive waypoints are connected by quintic (minimum jerk) segments, which start with the position, velocity and acceleration at the end of the previous segment.
+ * When the next waypoint is already queued when a segment starts, the segment ends with a blended velocity instead of coming to rest (lookahead of one waypoint).
+ * The duration of a segment is chosen so that a rest to rest segment respects the velocity, acceleration and jerk limits.
+ * Evaluating a tick is O(1): the polynomial coefficients are computed once per segment.
+ */
+class TrajectoryGenerator{
+public:
+    /** @brief queue a waypoint
+     * @param duration time to reach the waypoint from the previous one in s, 0 to choose it from the limits
+     * @param replace_pending drop the queued waypoints which have not been started yet, the running segment is finished.
+     * Use it for streamed targets, where only the latest one matters and the queue would otherwise grow faster than it is followed */
+    void add_waypoint(const Vector3d& x, double duration = 0, bool replace_pending = false);
+
+    /** @brief drop all queued waypoints and stop the current segment */
+    void clear();
+
+    /** @brief advance the trajectory by dt
+     * @param x, dx, ddx reference position, velocity and acceleration. When the generator is idle and a waypoint is queued, x is where the trajectory starts
+     * @return true if the reference was written, false if the generator is idle */
+    bool step(double dt, Vector3d& x, Vector3d& dx, Vector3d& ddx);
+
+    /** @brief whether a segment is running or waypoints are queued */
+    bool active();
+
+    /** @brief limits in m/s, m/s^2 and m/s^3 */
+    double max_velocity_ = 0.1;
+    double max_acceleration_ = 0.5;
+    double max_jerk_ = 5;
+    /** @brief shortest allowed segment, in s */
+    double min_duration_ = 0.05;
+
+private:
+    struct Waypoint{
+        Vector3d x;
+        double duration;
+    };
+
+    /** @brief duration of a rest to rest segment over distance, from the peak velocity 1.875 D/T, acceleration 5.7735 D/T^2 and jerk 60 D/T^3 of a minimum jerk profile */
+    double duration(double distance) const;
+
+    /** @brief start a segment from x0, dx0, ddx0 towards the front of the queue. Called with mtx_ locked */
+    void start_segment(const Vector3d& x0, const Vector3d& dx0, const Vector3d& ddx0);
+
+    /** @brief position, velocity and acceleration of the current segment at time t since its start */
+    void evaluate(double t, Vector3d& x, Vector3d& dx, Vector3d& ddx) const;
+
+    std::deque<Waypoint> queue_;
+    std::mutex mtx_;
+
+    bool running_ = false;
+    /** @brief coefficients of the current segment, x(t) = sum_i coeffs_.col(i) t^i */
+    Matrix<double, 3, 6> coeffs_;
+    double t_ = 0;
+    double T_ = 0;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+
+/**
+ * @brief Wait-free snapshot of a value, written by one thread and read by another.
+ * @details Three copies of the value are kept: the one being written, the one being read, and the latest published one in between.
+ * publish() and read() only swap indices with one atomic exchange, so neither side ever waits for the other, and the reader always gets the latest complete value.
+ * Values which were published but never read are overwritten, as with a mutex protected member.
+ * @tparam T copy assignable element type
+ */
+template <typename T>
+class TripleBuffer{
+public:
+    /** @param blank value every copy is initialized with, e.g. a blank state of the right size */
+    TripleBuffer(const T& blank = T()) : buffers_{blank, blank, blank} {}
+
+    /** @brief the copy to write the next value into, only used by the writer. It holds an older value, so it must be overwritten entirely */
+    T& back() { return buffers_[back_]; }
+
+    /** @brief make the value in back() the latest one, only called by the writer */
+    void publish(){
+        back_ = middle_.exchange(back_ | fresh_, std::memory_order_acq_rel) & index_;
+    }
+
+    /** @brief copy the latest published value into value, only called by the reader
+     * @return false if nothing was published since the last read, in which case value is not modified */
+    bool read(T& value){
+        if (!(middle_.load(std::memory_order_relaxed) & fresh_))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index_;
+        value = buffers_[front_];
+        return true;
+    }
+
+private:
+    /** @brief the index of the middle copy is stored with a flag which tells if it was published after the last read */
+    static constexpr int index_ = 3;
+    static constexpr int fresh_ = 4;
+
+    std::array<T, 3> buffers_;
+    int back_ = 0;
+    alignas(64) std::atomic<int> middle_{1};
+    alignas(64) int front_ = 2;
+};
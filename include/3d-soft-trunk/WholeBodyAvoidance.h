@@ -0,0 +1,66 @@
+#pragma once
+
+#include "3d-soft-trunk/SoftTrunk_common.h"
+#include "3d-soft-trunk/PCCKinematics.h"
+#include <unordered_map>
+
+/**
+ * @brief Repulsive potential fields acting on the whole body of the arm, instead of only the tip.
+ * @details The arm is covered with spheres, sampled along each PCC section and at the end of each connector.
+ * Their positions and position jacobians are computed with PCCKinematics, in the frame of the tip transforms of the state (the motion capture frame).
+ * Obstacles are spheres, kept in a uniform grid whose cells are as large as the range of the field, so every body point only checks the obstacles in the 27 cells around it.
+ * The distances to these candidates are computed in one vectorized expression.
+ * The force on each body point is \f$ F = k (1/d - 1/d_0) n \f$ for a surface distance d below the cutoff \f$ d_0 \f$,
+ * and is mapped to generalized forces with the transpose of the jacobian of the point.
+ */
+class WholeBodyAvoidance{
+public:
+    /** @param points_per_section number of spheres sampled along every PCC section */
+    WholeBodyAvoidance(const SoftTrunkParameters& st_params, int points_per_section = 4);
+
+    /** @brief replace the obstacles, and rebuild the spatial index
+     * @param centers positions of the obstacles
+     * @param radii radius of each obstacle */
+    void set_obstacles(const std::vector<Vector3d>& centers, const std::vector<double>& radii);
+
+    /** @brief generalized forces (size q_size) which push the arm away from the obstacles at configuration q */
+    VectorXd torques(const Ref<const VectorXd>& q);
+
+    /** @brief strength k of the field, in N m */
+    double strength_ = 0.002;
+    /** @brief surface distance beyond which an obstacle has no effect, in m */
+    double cutoff_distance_ = 0.05;
+
+    /** @brief positions, radii and forces of the body points, as of the last call to torques() */
+    const std::vector<Vector3d>& points() const { return points_; }
+    const std::vector<double>& point_radii() const { return point_radii_; }
+    const std::vector<Vector3d>& forces() const { return forces_; }
+
+    /** @brief smallest surface distance between the arm and an obstacle in range, as of the last call to torques(). Infinite if none is in range */
+    double min_distance() const { return min_distance_; }
+
+private:
+    /** @brief grid cell containing x */
+    long long int cell_key(const Vector3d& x) const;
+    long long int cell_key(long long int i, long long int j, long long int k) const;
+
+    const SoftTrunkParameters st_params_;
+    const int points_per_section_;
+
+    PCCKinematics kinematics_;
+
+    std::vector<Vector3d> points_;
+    std::vector<double> point_radii_;
+    std::vector<Vector3d> forces_;
+    double min_distance_;
+
+    Matrix3Xd obstacle_centers_;
+    VectorXd obstacle_radii_;
+    /** @brief obstacle indices in each occupied grid cell */
+    std::unordered_map<long long int, std::vector<int>> grid_;
+    double cell_size_ = 0;
+
+    /** @brief candidate obstacles of a body point, reused between queries */
+    std::vector<int> candidates_;
+    Matrix3Xd candidate_centers_;
+};
@@ -7,15 +7,17 @@
 
 
 
-ControllerPCC::ControllerPCC(const SoftTrunkParameters st_params) : st_params_(st_params){
+ControllerPCC::ControllerPCC(const SoftTrunkParameters st_params, Executor* executor) : st_params_(st_params), executor_(executor){
     assert(st_params_.is_finalized());
 
     // set appropriate size for each member
     state_ = st_params_.getBlankState();
+    state_pred_ = state_;
     state_prev_.setSize(st_params_.q_size);
     state_ref_.setSize(st_params_.q_size);
     p_ = VectorXd::Zero(st_params_.p_size);
     f_ = VectorXd::Zero(st_params_.q_size);
+    p_sent_ = -VectorXi::Ones(st_params_.p_size);
     dt_ = 1./st_params_.controller_update_rate;
 
     run_ = true;
@@ -25,37 +27,79 @@ ControllerPCC::ControllerPCC(const SoftTrunkParameters st_params) : st_params_(s
     //initialize data gathering and actuator objects
     mdl_ = std::make_unique<Model>(st_params_);
     ste_ = std::make_unique<StateEstimator>(st_params_);
+    ik_ = std::make_unique<InverseKinematics>(st_params_);
+    tip_force_ = std::make_unique<TipForceEstimator>(st_params_);
+    tip_kinematics_ = std::make_unique<PCCKinematics>(st_params_);
+    tip_kinematics_->set_points({tip_kinematics_->segment_end(st_params_.num_segments - 1)});
 
     if(st_params_.sensors[0]!=SensorType::simulator){
-        vc_ = std::make_unique<ValveController>("192.168.0.100", st_params_.valvemap, st_params_.p_max);
+        if (st_params_.sensors[0]!=SensorType::simulated) // the simulated sensor takes the pressures instead of the valves
+            vc_ = std::make_unique<ValveController>(st_params_.valve_address, st_params_.valvemap, st_params_.p_max);
+        if (st_params_.dynamics_update_rate > 0)
+            kinematics_mdl_ = std::make_unique<Model>(st_params_);
+        if (st_params_.parameter_adaptation)
+            adaptation_ = std::make_unique<ParameterAdaptation>(st_params_, mdl_->dyn_);
     }
     
-    //start the state update loops
-    sensor_thread_ = std::thread(&ControllerPCC::sensor_loop, this);
-    model_thread_ = std::thread(&ControllerPCC::model_loop, this);
+    if (st_params_.lock_memory)
+        lock_memory();
+    if (st_params_.lock_memory || st_params_.timer_spin_us > 0 || st_params_.control_schedule.priority > 0 || !st_params_.control_schedule.cpus.empty()){
+        // check that the real time configuration is effective before relying on it
+        RTRate::Jitter jitter = measure_jitter(st_params_.control_schedule, 1000., st_params_.timer_spin_us, 200);
+        fmt::print("Timer wakeup latency with the control thread configuration: mean {:.1f}us, max {:.1f}us.\n", jitter.mean_us, jitter.max_us);
+    }
+
+    //start the state update loops. in simulation, the state and model are updated within simulate() instead
+    if (st_params_.sensors[0] != SensorType::simulator){
+        if (executor_){
+            tasks_.push_back(executor_->add_task([this]{sensor_step();}, st_params_.sensor_refresh_rate));
+            tasks_.push_back(executor_->add_task([this]{model_step();}, model_rate()));
+        } else {
+            sensor_thread_ = std::thread(&ControllerPCC::sensor_loop, this);
+            model_thread_ = std::thread(&ControllerPCC::model_loop, this);
+        }
+    }
 
     fmt::print("ControllerPCC object initialized with max pressure {}.\n", st_params_.p_max);
 }
 
 ControllerPCC::~ControllerPCC(){
+    stop();
+}
+
+void ControllerPCC::stop(){
     run_ = false;
+    for (int task : tasks_)
+        executor_->remove_task(task);
+    tasks_.clear();
     if (control_thread_.joinable()){
         control_thread_.join();
     }
-    sensor_thread_.join();
-    model_thread_.join();
+    if (sensor_thread_.joinable())
+        sensor_thread_.join();
+    if (model_thread_.joinable())
+        model_thread_.join();
+}
+
+void ControllerPCC::start_control(){
+    if (executor_)
+        tasks_.push_back(executor_->add_task([this]{control_step();}, 1./dt_));
+    else
+        control_thread_ = std::thread(&ControllerPCC::control_loop, this);
 }
 
 void ControllerPCC::set_ref(const srl::State &state_ref) {
     std::lock_guard<std::mutex> lock(mtx);
     // assign to member variables
     this->state_ref_ = state_ref;
+    ik_reference_ = false;
     if (!is_initial_ref_received)
         is_initial_ref_received = true;
 }
 
 void ControllerPCC::set_ref(const Vector3d &x_ref, const Vector3d &dx_ref, const Vector3d &ddx_ref){
     std::lock_guard<std::mutex> lock(mtx);
+    trajectory_.clear();
 
     this->x_ref_ = x_ref;
     this->dx_ref_ = dx_ref;
@@ -64,23 +108,91 @@ void ControllerPCC::set_ref(const Vector3d &x_ref, const Vector3d &dx_ref, const
         is_initial_ref_received = true;
 }
 
+void ControllerPCC::set_ref_ik(const Vector3d &x_ref, const Vector3d &dx_ref){
+    std::lock_guard<std::mutex> lock(mtx);
+    trajectory_.clear();
+
+    this->x_ref_ = x_ref;
+    this->dx_ref_ = dx_ref;
+    this->ddx_ref_ = Vector3d::Zero();
+    if (!ik_reference_)
+        state_ref_.q = state_.q; // start from the current configuration
+    ik_reference_ = true;
+    update_ik_ref();
+    if (!is_initial_ref_received)
+        is_initial_ref_received = true;
+}
+
+void ControllerPCC::update_ik_ref(){
+    VectorXd q = state_ref_.q;
+    ik_->solve(x_ref_, q);
+    ik_error_ = ik_->error();
+    state_ref_.q = q;
+    state_ref_.dq = ik_->velocity(dx_ref_);
+    state_ref_.ddq.setZero();
+}
+
+void ControllerPCC::add_waypoint(const Vector3d &x, double duration, bool replace_pending){
+    trajectory_.add_waypoint(x, duration, replace_pending);
+}
+
+void ControllerPCC::clear_waypoints(){
+    std::lock_guard<std::mutex> lock(mtx);
+    trajectory_.clear();
+    dx_ref_ = Vector3d::Zero();
+    ddx_ref_ = Vector3d::Zero();
+}
+
 void ControllerPCC::toggleGripper(){
     assert(gripperAttached_);
     gripping_ = !gripping_;
-    vc_->setSinglePressure(3*st_params_.num_segments, gripping_*350); //350mbar to grip
+    VectorXd p = p_sent_.cwiseMax(0).cast<double>();
+    p(3*st_params_.num_segments) = gripping_*350; //350mbar to grip
+    setPressures(p);
+}
+
+void ControllerPCC::setPressures(const VectorXd &p){
+    assert(p.size() == st_params_.p_size);
+    SimulatedSensor* simulated = ste_->simulated_sensor();
+    assert(vc_ || simulated);
+    std::lock_guard<std::mutex> lock(valve_mtx);
+    unsigned long long int start = srl::monotonic_us();
+    for (int i = 0; i < st_params_.p_size; i++){
+        int pressure = (int) std::round(p(i));
+        if (p_sent_(i) >= 0 && abs(pressure - p_sent_(i)) <= st_params_.valve_change_threshold){
+            commands_suppressed_++;
+            continue;
+        }
+        if (vc_)
+            vc_->setSinglePressure(i, pressure);
+        p_sent_(i) = pressure;
+        commands_sent_++;
+    }
+    if (!vc_)
+        simulated->set_pressure(p_sent_.cwiseMax(0).cast<double>());
+    command_latency_ = (srl::monotonic_us() - start)/1.0e6;
 }
 
 void ControllerPCC::actuate(const VectorXd &p) { //actuates valves according to mapping from header
     assert(p.size() == st_params_.p_size);
     if (st_params_.sensors[0]==SensorType::simulator){
-        simulate(p);
-    } else{
-        for (int i = 0; i < st_params_.p_size; i++){
-            vc_->setSinglePressure(i, p(i));
-        }
+        simulate(p); // simulate() logs by itself
+        return;
+    }
+    setPressures(p);
+
+    // measure how old the state was when the pressure was applied
+    unsigned long long int now = srl::monotonic_us();
+    if (measurement_timestamp_ != 0 && now > measurement_timestamp_){
+        double age = (now - measurement_timestamp_)/1.0e6;
+        latency_ = (latency_ == 0) ? age : 0.9*latency_ + 0.1*age;
+    }
+    if (tick_start_ != 0 && now > tick_start_){
+        double delay = (now - tick_start_)/1.0e6;
+        compute_delay_ = (compute_delay_ == 0) ? delay : 0.9*compute_delay_ + 0.1*delay;
     }
     if (logging_){  
-        log(state_.timestamp/10e6);       //log once per control timestep
+        log((state_.timestamp - initial_timestamp_)/1.0e6);       //log once per control timestep
     }
 }
 
@@ -103,6 +215,7 @@ bool ControllerPCC::simulate(const VectorXd &p){
     }
 
     state_.q = state_.q + state_.dq*dt_ + (dt_*dt_*(4*state_.ddq - state_prev_.ddq) / 6);
+    state_.timestamp = srl::monotonic_us(); //a new version of the state for the model
 
 
     if (logging_){ //log once per control timestep
@@ -124,7 +237,7 @@ void ControllerPCC::toggle_log(){
         log_file_ << "timestamp";
 
         //write header
-        log_file_ << fmt::format(", x, y, z, x_ref, y_ref, z_ref, err");
+        log_file_ << fmt::format(", x, y, z, x_ref, y_ref, z_ref, err, latency, horizon, correction, cmd_latency, singularity, f_tip_x, f_tip_y, f_tip_z");
 
         for (int i=0; i < st_params_.q_size; i++)
             log_file_ << fmt::format(", q_{}", i);
@@ -142,11 +255,16 @@ void ControllerPCC::toggle_log(){
 void ControllerPCC::log(double time){
     Vector3d x_tip = Vector3d::Zero();
 
-    if (st_params_.sensors[0] == SensorType::qualisys){
+    log_file_ << time;
+
+    if (st_params_.sensors[0] == SensorType::qualisys || st_params_.sensors[0] == SensorType::simulated){
         x_tip = state_.tip_transforms[st_params_.prismatic].rotation()*(state_.tip_transforms[st_params_.num_segments+st_params_.prismatic].translation()-state_.tip_transforms[st_params_.prismatic].translation());
     }
 
     log_file_ << fmt::format(", {}, {}, {}, {}, {}, {}, {}", x_tip(0), x_tip(1), x_tip(2), x_ref_(0), x_ref_(1), x_ref_(2), (x_tip - x_ref_).norm());
+    log_file_ << fmt::format(", {}, {}, {}, {}, {}", latency_, prediction_horizon_, prediction_correction_, command_latency_, singularity_measure_);
+    const Vector3d& f_tip = tip_force_->force();
+    log_file_ << fmt::format(", {}, {}, {}", f_tip(0), f_tip(1), f_tip(2));
 
     for (int i=0; i < st_params_.q_size; i++)               //log q
         log_file_ << fmt::format(", {}", state_.q(i));
@@ -155,30 +273,175 @@ void ControllerPCC::log(double time){
     log_file_ << "\n";
 }
 
-void ControllerPCC::sensor_loop(){
-    srl::Rate r{st_params_.sensor_refresh_rate};
+bool ControllerPCC::control_law(){
+    return false;
+}
+
+Vector3d ControllerPCC::tip_force(){
+    std::lock_guard<std::mutex> lock(mtx);
+    return tip_force_->force();
+}
+
+void ControllerPCC::tare_tip_force(int samples){
+    std::lock_guard<std::mutex> lock(mtx);
+    tip_force_->tare(samples);
+}
+
+bool ControllerPCC::control_tick(){
+    std::lock_guard<std::mutex> lock(mtx);
+    state_pred_ = state_;
+    x_ = state_.tip_transforms[st_params_.num_segments+st_params_.prismatic].translation();
+    return control_law();
+}
+
+void ControllerPCC::control_loop(){
+    apply_schedule(st_params_.control_schedule, "control");
+    RTRate r{1./dt_, st_params_.timer_spin_us};
     while(run_){
         r.sleep();
-        if (st_params_.sensors[0] == SensorType::simulator)
-            continue;  // in simulation model, the state is updated within simulate()
+        control_step();
+    }
+}
 
-        ste_->poll_sensors();
-        this->state_ = ste_->state_;
+void ControllerPCC::control_step(){
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!dyn_.J.empty() && state_.timestamp != tip_force_timestamp_){ //once per measurement (or simulation step), after the model has been updated at least once
+        tip_force_->update(state_, dyn_, p_);
+        tip_force_timestamp_ = state_.timestamp;
+    }
+    compensate_latency(); //predict the state at actuation time, if enabled
+    if (kinematics_mdl_){
+        // fresh jacobians and gravity at the state the control law uses
+        kinematics_mdl_->update_kinematics(state_pred_);
+        dyn_.J = kinematics_mdl_->dyn_.J;
+        dyn_.g = kinematics_mdl_->dyn_.g;
+        dyn_.kinematics_timestamp = kinematics_mdl_->dyn_.kinematics_timestamp;
+    }
+
+    //update the internal visualization, the measured tip position moved to the predicted state
+    x_ = state_.tip_transforms[st_params_.num_segments+st_params_.prismatic].translation() + x_prediction_;
+
+    if (!is_initial_ref_received)
+        x_ref_ = x_;    //a trajectory starts at the tip if there is no reference yet
+    if (trajectory_.step(dt_, x_ref_, dx_ref_, ddx_ref_))
+        is_initial_ref_received = true;
+    if (ik_reference_)
+        update_ik_ref(); // warm started, a converged reference costs one kinematics update
+
+    if (!is_initial_ref_received) //only control after receiving a reference position
+        return;
+
+    if (control_law())
+        actuate(p_);
+}
+
+void ControllerPCC::sensor_loop(){
+    apply_schedule(st_params_.sensor_schedule, "sensor");
+    RTRate r{st_params_.sensor_refresh_rate, st_params_.timer_spin_us};
+    while(run_){
+        r.sleep();
+        sensor_step();
     }
 }
 
+void ControllerPCC::sensor_step(){
+    ste_->poll_sensors();
+    std::lock_guard<std::mutex> lock(mtx);
+    this->state_ = ste_->state_;
+    measurement_timestamp_ = state_.timestamp;
+}
+
 void ControllerPCC::model_loop(){
-    srl::Rate r{st_params_.model_update_rate};
+    apply_schedule(st_params_.model_schedule, "model");
+    RTRate r{model_rate(), st_params_.timer_spin_us};
     while(run_){
         r.sleep();
-        if (st_params_.sensors[0] == SensorType::simulator)
-            continue;  // in simulation model, the model is updated within simulate()
-        // TODO: this may conflict with the visualization loop if state is not received from the sensor?
-        mdl_->update(state_);
+        model_step();
+    }
+}
+
+void ControllerPCC::model_step(){
+    srl::State state;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        state = state_;
+    }
+    mdl_->update(state); //reuses the last results if the state did not change
+    if (adaptation_){
+        VectorXd p;
+        {
+            std::lock_guard<std::mutex> lock(valve_mtx);
+            p = p_sent_.cwiseMax(0).cast<double>();
+        }
+        if (state.timestamp != 0 && state.timestamp != sample_timestamp_){ //every new measurement, even if the model reused its results
+            adaptation_->add_sample(state, mdl_->dyn_, p);
+            sample_timestamp_ = state.timestamp;
+        }
+        if (auto params = adaptation_->parameters()){
+            mdl_->dyn_.K = params->K;
+            mdl_->dyn_.D = params->D;
+            mdl_->dyn_.A = params->A;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (kinematics_mdl_ && dyn_.J.size() && dyn_.kinematics_timestamp >= mdl_->dyn_.kinematics_timestamp){
+        DynamicParams dyn = mdl_->dyn_;
+        dyn.J = dyn_.J;
+        dyn.g = dyn_.g;
+        dyn.kinematics_timestamp = dyn_.kinematics_timestamp;
+        this->dyn_ = dyn;
+    } else {
         this->dyn_ = mdl_->dyn_;
     }
 }
 
+unsigned long int ControllerPCC::model_updates_computed() const {
+    return mdl_->updates_computed_ + (kinematics_mdl_ ? kinematics_mdl_->updates_computed_.load() : 0);
+}
+
+unsigned long int ControllerPCC::model_updates_skipped() const {
+    return mdl_->updates_skipped_ + (kinematics_mdl_ ? kinematics_mdl_->updates_skipped_.load() : 0);
+}
+
+double ControllerPCC::model_rate() const {
+    return (st_params_.dynamics_update_rate > 0) ? st_params_.dynamics_update_rate : st_params_.model_update_rate;
+}
+
+void ControllerPCC::compensate_latency(){
+    tick_start_ = srl::monotonic_us();
+    prediction_horizon_ = 0;
+    prediction_correction_ = 0;
+    x_prediction_.setZero();
+    state_pred_ = state_;
+    if (!st_params_.latency_compensation || st_params_.sensors[0] == SensorType::simulator)
+        return;
+    if (state_.timestamp == 0 || dyn_.B.rows() != st_params_.q_size) // no measurement or model yet
+        return;
+
+    // always integrate from the latest measurement, so a prediction is never used as the start of the next one
+    unsigned long long int t_actuation = tick_start_ + (unsigned long long int) (compute_delay_*1.0e6);
+    if (t_actuation <= state_.timestamp)
+        return;
+    prediction_horizon_ = std::min((t_actuation - state_.timestamp)/1.0e6, 0.1);
+
+    LDLT<MatrixXd> B_ldlt = dyn_.B.ldlt();
+    VectorXd tau_const = dyn_.A * 100*p_ - dyn_.c - dyn_.g; //convert p from mbar
+    const double h = 0.001;
+    for (double t = 0; t < prediction_horizon_; t += h){ //semi-implicit euler
+        double step = std::min(h, prediction_horizon_ - t);
+        state_pred_.ddq = B_ldlt.solve(tau_const - dyn_.K * state_pred_.q - dyn_.D * state_pred_.dq);
+        state_pred_.dq += step * state_pred_.ddq;
+        state_pred_.q += step * state_pred_.dq;
+    }
+    state_pred_.timestamp = t_actuation;
+    prediction_correction_ = (state_pred_.q - state_.q).norm();
+
+    tip_kinematics_->update(state_.q, false);
+    const Vector3d x_measured = tip_kinematics_->position(0);
+    tip_kinematics_->update(state_pred_.q, false);
+    x_prediction_ = tip_kinematics_->position(0) - x_measured;
+}
+
 int ControllerPCC::singularity(const MatrixXd &J) {
     int order = 0;
     std::vector<Eigen::Vector3d> plane_normals(st_params_.num_segments);            //normals to planes create by jacobian
@@ -197,7 +460,7 @@ int ControllerPCC::singularity(const MatrixXd &J) {
 }
 
 
-VectorXd ControllerPCC::gravity_compensate(const srl::State state){
+VectorXd ControllerPCC::gravity_compensate(const srl::State& state){
     assert(st_params_.sections_per_segment == 1);
     VectorXd gravcomp = dyn_.A_pseudo.inverse() * (dyn_.g + dyn_.K * state.q + dyn_.D * state.dq + dyn_.c);
     return gravcomp/100; //to mbar
@@ -94,9 +94,11 @@ void Characterize::stiffness(int segment, int verticalsteps, int maxpressure){
 
 bool Characterize::valveMap(int maxpressure){
     std::vector<int> newMap(st_params_.p_size);
+    VectorXd p = VectorXd::Zero(st_params_.p_size);
 
     for (int i = 0; i < st_params_.p_size - 2*st_params_.prismatic; i++){
-        vc_->setSinglePressure(i+2*st_params_.prismatic,300);
+        p(i+2*st_params_.prismatic) = 300;
+        setPressures(p);
         srl::sleep(7);
         int segment = 0;
         double largest = 0;
@@ -133,7 +135,8 @@ bool Characterize::valveMap(int maxpressure){
             else return false;
         }
 
-        vc_->setSinglePressure(i+2*st_params_.prismatic,0);
+        p(i+2*st_params_.prismatic) = 0;
+        setPressures(p);
     }
 
     if(st_params_.prismatic){
@@ -160,8 +163,10 @@ void Characterize::actuation(int segment, int pressure){
     int rotation = 360;
     MatrixXd p = MatrixXd::Zero(3,rotation);
     MatrixXd Kqg = MatrixXd::Zero(2,rotation);
+    VectorXd p_valves = VectorXd::Zero(st_params_.p_size);
 
-    vc_->setSinglePressure(2*st_params_.prismatic+segment*3, pressure);
+    p_valves(2*st_params_.prismatic+segment*3) = pressure;
+    setPressures(p_valves);
     srl::sleep(8);
     srl::Rate r{2};
 
@@ -171,17 +176,15 @@ void Characterize::actuation(int segment, int pressure){
         if (i >= 120 && i < 240) p.block(0,i,3,1) << 0, sin(i*deg2rad*90/120)*pressure, sin((i-120)*90*deg2rad/120)*pressure;
         if (i >= 240 && i < 360) p.block(0,i,3,1) << sin((i-240)*deg2rad*90/120)*pressure, 0, sin((i-120)*90*deg2rad/120)*pressure;
 
-        vc_->setSinglePressure(2*st_params_.prismatic+segment*3, p(0,i));
-        vc_->setSinglePressure(2*st_params_.prismatic+segment*3+1, p(1,i));
-        vc_->setSinglePressure(2*st_params_.prismatic+segment*3+2, p(2,i));
+        p_valves.segment(2*st_params_.prismatic+segment*3, 3) = p.col(i);
+        setPressures(p_valves);
 
         Kqg.block(0,i,2,1) = (dyn_.g + dyn_.K*state_.q).segment(st_params_.prismatic + 2*segment, 2);
 
         r.sleep();
     }
-    vc_->setSinglePressure(2*st_params_.prismatic+segment*3, 0);
-    vc_->setSinglePressure(2*st_params_.prismatic+segment*3+1, 0);
-    vc_->setSinglePressure(2*st_params_.prismatic+segment*3+2, 0);
+    p_valves.segment(2*st_params_.prismatic+segment*3, 3) = Vector3d::Zero();
+    setPressures(p_valves);
 
     p = p*100*dyn_.A_pseudo(st_params_.prismatic + segment*2, st_params_.prismatic + segment*2);
 
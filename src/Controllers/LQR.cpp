@@ -1,6 +1,6 @@
 #include "3d-soft-trunk/Controllers/LQR.h"
 
-LQR::LQR(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_params){
+LQR::LQR(const SoftTrunkParameters st_params, Executor* executor) : ControllerPCC::ControllerPCC(st_params, executor){
     filename_ = "LQR_log";
 
     A = MatrixXd::Zero(2*st_params.q_size, 2*st_params.q_size);
@@ -10,18 +10,44 @@ LQR::LQR(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_
     Q = 100000*MatrixXd::Identity(2*st_params.q_size, 2*st_params.q_size);
     Q.block(st_params.q_size, st_params.q_size, st_params.q_size, st_params.q_size) *= 0.001; // reduce cost for velocity
 
+    fullstate = VectorXd::Zero(2*st_params.q_size);
+    fullstate_ref = VectorXd::Zero(2*st_params.q_size);
+
+    if (st_params_.sensors[0] == SensorType::simulator){
+        // in simulation there is no model loop, so mdl_ is not shared yet and can fill dyn_ for the first linearization
+        mdl_->update(state_);
+        dyn_ = mdl_->dyn_;
+    } else {
+        // the model loop is already running on mdl_, wait for its first update of dyn_ instead of racing it
+        while (true){
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (dyn_.B.rows() == st_params_.q_size)
+                    break;
+            }
+            srl::sleep(0.01);
+        }
+    }
     relinearize(); //linearizes in non-actuated position on startup
 
-    control_thread_ = std::thread(&LQR::control_loop, this);
+    start_control();
 }
 
 void LQR::relinearize(){    
     //update A, B with new dynamics
-    //this function takes FOREVER to execute
-    A << MatrixXd::Zero(st_params_.q_size,st_params_.q_size), MatrixXd::Identity(st_params_.q_size, st_params_.q_size), - dyn_.B.inverse() * dyn_.K, -dyn_.B.inverse() * dyn_.D;
-    B << MatrixXd::Zero(st_params_.q_size, 2*st_params_.num_segments), dyn_.B.inverse()*dyn_.A_pseudo;
+    //this function takes FOREVER to execute, so only the copies of dyn_ and K hold mtx
+    DynamicParams dyn;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        dyn = dyn_;
+    }
+    A << MatrixXd::Zero(st_params_.q_size,st_params_.q_size), MatrixXd::Identity(st_params_.q_size, st_params_.q_size), - dyn.B.inverse() * dyn.K, -dyn.B.inverse() * dyn.D;
+    B << MatrixXd::Zero(st_params_.q_size, 2*st_params_.num_segments), dyn.B.inverse()*dyn.A_pseudo;
 
-    solveRiccati(A, B, Q, R, K);
+    MatrixXd K_new;
+    solveRiccati(A, B, Q, R, K_new);
+    std::lock_guard<std::mutex> lock(mtx);
+    K = K_new;
 }
 
 void LQR::solveRiccati(const MatrixXd &A, const MatrixXd &B, const MatrixXd &Q, const MatrixXd &R, MatrixXd &K) {
@@ -55,25 +81,13 @@ void LQR::solveRiccati(const MatrixXd &A, const MatrixXd &B, const MatrixXd &Q,
 }
 
 
-void LQR::control_loop() {
-    srl::Rate r{1./dt_};
-    while(run_){
-        r.sleep();
-        std::lock_guard<std::mutex> lock(mtx);
+bool LQR::control_law() {
+    // for LQR, use "fullstate" which is just a vector combining both q and dq
+    fullstate << state_pred_.q, state_pred_.dq;
+    fullstate_ref << state_ref_.q, state_ref_.dq;
 
-        if (!is_initial_ref_received) //only control after receiving a reference position
-            continue;
-        
-        //do controls
+    f_ = K*(fullstate_ref - fullstate)/100;
 
-        // for LQR, use "fullstate" which is just a vector combining both q and dq
-        fullstate << state_.q, state_.dq;
-        fullstate_ref << state_ref_.q, state_ref_.dq;
-
-        f_ = K*(fullstate_ref - fullstate)/100;
-
-        p_ = mdl_->pseudo2real(f_ + gravity_compensate(state_));
-
-        actuate(p_);
-    }
+    p_ = mdl_->pseudo2real(f_ + gravity_compensate(state_pred_));
+    return true;
 }
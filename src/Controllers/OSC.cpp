@@ -1,8 +1,12 @@
 #include "3d-soft-trunk/Controllers/OSC.h"
 
-OSC::OSC(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_params){
+OSC::OSC(const SoftTrunkParameters st_params, Executor* executor) : ControllerPCC::ControllerPCC(st_params, executor){
     filename_ = "OSC_logger";
 
+    avoidance_ = std::make_unique<WholeBodyAvoidance>(st_params_);
+    obstacle_centers_.reserve(st_params_.objects);
+    obstacle_radii_.reserve(st_params_.objects);
+
     potfields_.resize(st_params_.objects);
     for (int i = 0; i < st_params_.objects; i++) {
         potfields_[i].cutoff_distance_ = 0.5;
@@ -18,62 +22,76 @@ OSC::OSC(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_
     //OSC needs a higher refresh rate than other controllers
     dt_ = 1./80;
 
-    control_thread_ = std::thread(&OSC::control_loop, this);
+    start_control();
 }
 
-void OSC::control_loop() {
-    srl::Rate r{1./dt_};
-    while(run_){
-        r.sleep();
-        std::lock_guard<std::mutex> lock(mtx);
-
-        //update the internal visualization
-        x_ = state_.tip_transforms[st_params_.num_segments+st_params_.prismatic].translation();
-
-        if (!is_initial_ref_received) //only control after receiving a reference position
-            continue;
+bool OSC::control_law() {
+    J = dyn_.J[st_params_.num_segments-1+st_params_.prismatic];
 
-        J = dyn_.J[st_params_.num_segments-1+st_params_.prismatic];
+    dx_ = J*state_pred_.dq;
+    
+    ddx_des = ddx_ref_ + kp_*(x_ref_ - x_) + kd_*(dx_ref_ - dx_);            //desired acceleration from PD controller
 
-        dx_ = J*state_.dq;
-        
-        ddx_des = ddx_ref_ + kp_*(x_ref_ - x_) + kd_*(dx_ref_ - dx_);            //desired acceleration from PD controller
+    if ((x_ref_ - x_).norm() > 0.05) { //saturate ddx_des if it's too far away
+        ddx_des = ddx_ref_ + kp_*(x_ref_ - x_).normalized()*0.05 + kd_*(dx_ref_ - dx_);  
+    }
 
-        if ((x_ref_ - x_).norm() > 0.05) { //saturate ddx_des if it's too far away
-            ddx_des = ddx_ref_ + kp_*(x_ref_ - x_).normalized()*0.05 + kd_*(dx_ref_ - dx_);  
+    for (int i = 0; i < potfields_.size(); i++) { //add the potential fields from objects to reference
+        if (!freeze){
+            potfields_[i].pos_ = state_pred_.objects[i].translation();
         }
-
-        for (int i = 0; i < potfields_.size(); i++) { //add the potential fields from objects to reference
-            if (!freeze){
-                potfields_[i].pos_ = state_.objects[i].translation();
-            }
+        if (!whole_body_avoidance_)
             ddx_des += potfields_[i].get_ddx(x_); 
-        }
+    }
+
+    task_space_.update(J, dyn_.B);
+    singularity_measure_ = task_space_.singularity_measure();
+    bool perturbed = false;
+    for (int i = 0; i < singularity(J); i++){               //reduce jacobian order if the arm is in a singularity
+        J.block(0,(st_params_.num_segments-1-i)*2,3,2) += 0.02*(i+1)*MatrixXd::Identity(3,2); //noise should fix it
+        perturbed = true;
+    }
+    if (perturbed)
+        task_space_.update(J, dyn_.B);
+
+    B_op = task_space_.operational_inertia(); //operational space inertia matrix
+    J_inv = task_space_.damped_pinv(0.5e-1, 1.0e-1);
+     
+    f_ = B_op*ddx_des;
+    
+    if (force_compensation_)
+        f_ -= tip_force_->force(); //compensate the estimated external force on the tip
+    else
+        f_(2) += 0.24*gripperAttached_; //compensate the gripper, which weighs 0.24 Newton
+
+    tau_null = -kd_*0.0001*state_pred_.dq; //try to reduce oscillations with nullspace input
+    
+    for(int i = 0; i < st_params_.q_size; i++){     //for some reason tau is sometimes nan, catch that
+        if(isnan(tau_null(i))) tau_null = VectorXd::Zero(2*st_params_.num_segments);
+    }
 
-        for (int i = 0; i < singularity(J); i++){               //reduce jacobian order if the arm is in a singularity
-            J.block(0,(st_params_.num_segments-1-i)*2,3,2) += 0.02*(i+1)*MatrixXd::Identity(3,2); //noise should fix it
+    tau_ref = J.transpose()*f_ + (MatrixXd::Identity(st_params_.q_size, st_params_.q_size) - J.transpose()*J_inv.transpose())*tau_null;
+
+    if (whole_body_avoidance_ && !potfields_.empty()){ //repulsion acting on all points of the arm, mapped to torques by the jacobians of the points
+        bool changed = obstacle_centers_.size() != potfields_.size() || obstacle_cutoff_ != avoidance_->cutoff_distance_;
+        obstacle_centers_.resize(potfields_.size());
+        obstacle_radii_.resize(potfields_.size());
+        for (int i = 0; i < potfields_.size(); i++){
+            if (obstacle_centers_[i] != potfields_[i].pos_ || obstacle_radii_[i] != potfields_[i].radius_){
+                obstacle_centers_[i] = potfields_[i].pos_;
+                obstacle_radii_[i] = potfields_[i].radius_;
+                changed = true;
+            }
         }
-        
-
-        B_op = (J*dyn_.B.inverse()*J.transpose()).inverse(); //operational space inertia matrix
-        J_inv = computePinv(J, 0.5e-1, 1.0e-1);
-         
-        f_ = B_op*ddx_des;
-        
-        f_(2) += loadAttached_ + 0.24*gripperAttached_; //compensate tip forces, the gripper weights 0.24 Newton
-
-        tau_null = -kd_*0.0001*state_.dq; //try to reduce oscillations with nullspace input
-        
-        for(int i = 0; i < st_params_.q_size; i++){     //for some reason tau is sometimes nan, catch that
-            if(isnan(tau_null(i))) tau_null = VectorXd::Zero(2*st_params_.num_segments);
+        if (changed){ //static obstacles, or a frozen scene, keep their spatial index
+            avoidance_->set_obstacles(obstacle_centers_, obstacle_radii_);
+            obstacle_cutoff_ = avoidance_->cutoff_distance_;
         }
-
-        tau_ref = J.transpose()*f_ + (MatrixXd::Identity(st_params_.q_size, st_params_.q_size) - J.transpose()*J_inv.transpose())*tau_null;
-
-        p_ = mdl_->pseudo2real(dyn_.A_pseudo.inverse()*tau_ref/100 + gravity_compensate(state_));
-
-        actuate(p_);
+        tau_ref += avoidance_->torques(state_pred_.q);
     }
+
+    p_ = mdl_->pseudo2real(dyn_.A_pseudo.inverse()*tau_ref/100 + gravity_compensate(state_pred_));
+    return true;
 }
 
 
@@ -100,31 +118,3 @@ Vector3d PotentialField::get_ddx(Vector3d &pos) {
     }
     return Vector3d::Zero();
 }
-
-//courtesy of amir
-template <typename Derived1, typename Derived2>
-void dampedPseudoInverse(const Eigen::MatrixBase<Derived1>& A, double e, double dampingFactor, Eigen::MatrixBase<Derived2>& Apinv, unsigned int computationOptions)
-{
-	int m = A.rows(), n = A.cols(), k = (m < n) ? m : n;
-	JacobiSVD<typename MatrixBase<Derived1>::PlainObject> svd = A.jacobiSvd(computationOptions);
-	const typename JacobiSVD<typename Derived1::PlainObject>::SingularValuesType& singularValues = svd.singularValues();
-	MatrixXd sigmaDamped = MatrixXd::Zero(k, k);
-	double damp = dampingFactor * dampingFactor;
-
-	for (int idx = 0; idx < k; idx++)
-	{
-		if (singularValues(idx) >= e)damp = 0;
-		else damp = (1 - ((singularValues(idx) / e)*(singularValues(idx) / e)))*dampingFactor * dampingFactor;
-		sigmaDamped(idx, idx) = singularValues(idx) / ((singularValues(idx) * singularValues(idx)) + damp);
-	}
-	Apinv = svd.matrixV() * sigmaDamped * svd.matrixU().transpose(); // damped pseudoinverse
-}
-
-//return pseudo inverse computed in dampedPseudoInverse function 
-MatrixXd OSC::computePinv(Eigen::MatrixXd j,double e,double lambda)
-{
-
-	Eigen::MatrixXd pJacobian(j.cols(), j.rows());
-	dampedPseudoInverse(j,e,lambda, pJacobian, Eigen::ComputeThinU | Eigen::ComputeThinV);
-	return pJacobian;
-}
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "3d-soft-trunk/Controllers/PID.h"
 
 
-PID::PID(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_params){
+PID::PID(const SoftTrunkParameters st_params, Executor* executor) : ControllerPCC::ControllerPCC(st_params, executor){
     filename_ = "PID_log";
 
     for (int j = 0; j < st_params.num_segments; ++j){
@@ -9,7 +9,7 @@ PID::PID(const SoftTrunkParameters st_params) : ControllerPCC::ControllerPCC(st_
             miniPIDs.push_back(ZieglerNichols(Ku[j], Tu[j], dt_)); // for Y direction
     }
 
-    control_thread_ = std::thread(&PID::control_loop, this);
+    start_control();
 }
 
 MiniPID PID::ZieglerNichols(double Ku, double period, double control_period) {
@@ -21,20 +21,10 @@ MiniPID PID::ZieglerNichols(double Ku, double period, double control_period) {
     return MiniPID(Kp, Ki, Kd);
 }
 
-void PID::control_loop(){
-    srl::Rate r{1./dt_};
-    while(run_){
-        r.sleep();
-        std::lock_guard<std::mutex> lock(mtx);
-
-        if (!is_initial_ref_received) //only control after receiving a reference position
-            continue;
-        
-        for (int i = 0; i < 2 * st_params_.num_segments; ++i)
-            f_[i] = miniPIDs[i].getOutput(state_.q[i], state_ref_.q[i]);
-        
-        p_ = mdl_->pseudo2real(f_ + gravity_compensate(state_));
-
-        actuate(p_);
-    }
+bool PID::control_law(){
+    for (int i = 0; i < 2 * st_params_.num_segments; ++i)
+        f_[i] = miniPIDs[i].getOutput(state_pred_.q[i], state_ref_.q[i]);
+    
+    p_ = mdl_->pseudo2real(f_ + gravity_compensate(state_pred_));
+    return true;
 }
\ No newline at end of file
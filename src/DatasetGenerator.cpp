@@ -0,0 +1,257 @@
+#include "3d-soft-trunk/DatasetGenerator.h"
+#include "3d-soft-trunk/Identification.h"
+#include <atomic>
+#include <filesystem>
+#include <random>
+
+DatasetGenerator::DatasetGenerator(const SoftTrunkParameters& st_params, int num_threads) : st_params_(st_params), num_threads_(std::max(1, num_threads)){
+    assert(st_params_.is_finalized());
+    p_max_ = st_params_.p_max;
+    dt_ = 1./st_params_.controller_update_rate;
+
+    // the models are created one after another, since each of them writes the URDF file
+    for (int i = 0; i < num_threads_; i++)
+        models_.push_back(std::make_unique<Model>(st_params_));
+    fmt::print("DatasetGenerator initialized with {} threads.\n", num_threads_);
+}
+
+bool DatasetGenerator::load_log(const std::string& filename){
+    std::vector<double> t;
+    std::vector<VectorXd> q;
+    std::vector<VectorXd> p;
+    if (!read_log(filename, st_params_, t, q, p))
+        return false;
+
+    // unlike Identification, q is not smoothed: the dataset should contain the states as measured
+    const int n = t.size();
+    int added = 0;
+    for (int i = 1; i < n - 1; i++){
+        srl::State state = st_params_.getBlankState();
+        state.q = q[i];
+        state.dq = (q[i+1] - q[i-1]) / (t[i+1] - t[i-1]);
+        state.timestamp = (unsigned long long int) (t[i]*1.0e6);
+        samples_.push_back(state);
+        pressures_.push_back(p[i]);
+        added++;
+    }
+    fmt::print("loaded {} samples from {}\n", added, filename);
+    return true;
+}
+
+std::vector<std::pair<std::string, std::vector<int>>> DatasetGenerator::fields() const {
+    const int q_size = st_params_.q_size;
+    std::vector<std::pair<std::string, std::vector<int>>> f = {
+        {"q", {q_size}},
+        {"dq", {q_size}},
+        {"p", {st_params_.p_size}},
+        {"B", {q_size, q_size}},
+        {"c", {q_size}},
+        {"g", {q_size}},
+        {"J", {st_params_.num_segments, 3, q_size}},
+        {"q_next", {q_size}},
+        {"dq_next", {q_size}},
+    };
+    return f;
+}
+
+int DatasetGenerator::record_size() const {
+    int size = 0;
+    for (const auto& field : fields()){
+        int n = 1;
+        for (int d : field.second)
+            n *= d;
+        size += n;
+    }
+    return size;
+}
+
+void DatasetGenerator::evaluate(Model& mdl, const srl::State& state, const VectorXd& p, double* record) const {
+    const int q_size = st_params_.q_size;
+    mdl.update(state, true);
+    const DynamicParams& dyn = mdl.dyn_;
+
+    Map<VectorXd>(record, q_size) = state.q;
+    record += q_size;
+    Map<VectorXd>(record, q_size) = state.dq;
+    record += q_size;
+    Map<VectorXd>(record, st_params_.p_size) = p;
+    record += st_params_.p_size;
+    Map<Matrix<double, Dynamic, Dynamic, RowMajor>>(record, q_size, q_size) = dyn.B;
+    record += q_size*q_size;
+    Map<VectorXd>(record, q_size) = dyn.c;
+    record += q_size;
+    Map<VectorXd>(record, q_size) = dyn.g;
+    record += q_size;
+    for (int s = 0; s < st_params_.num_segments; s++){
+        Map<Matrix<double, Dynamic, Dynamic, RowMajor>>(record, 3, q_size) = dyn.J[s];
+        record += 3*q_size;
+    }
+
+    // next state under constant pressure, integrated like the simulator with B, c and g frozen at the sample
+    LDLT<MatrixXd> B_ldlt = dyn.B.ldlt();
+    const VectorXd b_inv_rest = B_ldlt.solve(dyn.A * 100*p - dyn.c - dyn.g); //convert from mbar
+    const MatrixXd b_inv_k = B_ldlt.solve(dyn.K);
+    const MatrixXd b_inv_d = B_ldlt.solve(dyn.D);
+    VectorXd q = state.q;
+    VectorXd dq = state.dq;
+    for (double t = 0; t < dt_; t += substep_){ //semi-implicit euler
+        const double h = std::min(substep_, dt_ - t);
+        dq += h * (b_inv_rest - b_inv_k * q - b_inv_d * dq);
+        q += h * dq;
+    }
+    Map<VectorXd>(record, q_size) = q;
+    record += q_size;
+    Map<VectorXd>(record, q_size) = dq;
+}
+
+long long int DatasetGenerator::generate(const std::string& directory, long long int num_samples){
+    assert(chunk_size_ > 0 && substep_ > 0 && dt_ > 0);
+    const bool replay = !samples_.empty();
+    const long long int n = replay ? samples_.size() : num_samples;
+    const int record = record_size();
+    std::filesystem::create_directories(directory);
+
+    std::atomic<long long int> done{0};
+    std::atomic<int> running{num_threads_};
+    std::vector<long long int> written(num_threads_, 0);
+    std::vector<std::string> shards(num_threads_);
+    auto worker = [&](int thread){
+        Model& mdl = *models_[thread];
+        std::mt19937_64 random(seed_ + thread);
+        std::uniform_real_distribution<double> uniform(-1., 1.);
+
+        shards[thread] = fmt::format("shard_{:05d}.bin", thread);
+        std::ofstream file(directory + "/" + shards[thread], std::ios::binary | std::ios::trunc);
+        if (!file.is_open()){
+            fmt::print("could not open {}/{}\n", directory, shards[thread]);
+            running--;
+            return;
+        }
+        std::vector<double> chunk(chunk_size_*record);
+        std::vector<float> chunk_float(single_precision_ ? chunk_size_*record : 0);
+        auto flush = [&](int records){
+            if (single_precision_){
+                std::copy(chunk.begin(), chunk.begin() + records*record, chunk_float.begin());
+                file.write(reinterpret_cast<const char*>(chunk_float.data()), records*record*sizeof(float));
+            }
+            else
+                file.write(reinterpret_cast<const char*>(chunk.data()), records*record*sizeof(double));
+        };
+
+        srl::State state = st_params_.getBlankState();
+        VectorXd p = VectorXd::Zero(st_params_.p_size);
+        int in_chunk = 0;
+        // every thread gets a contiguous range of samples, and writes it to its own shard
+        for (long long int k = n*thread/num_threads_; k < n*(thread+1)/num_threads_; k++){
+            if (replay){
+                evaluate(mdl, samples_[k], pressures_[k], &chunk[in_chunk*record]);
+            }
+            else {
+                for (int i = 0; i < st_params_.q_size; i++){
+                    state.q(i) = q_range_*uniform(random);
+                    state.dq(i) = dq_range_*uniform(random);
+                }
+                if (st_params_.coord_type == CoordType::phitheta){
+                    for (int s = 0; s < st_params_.num_segments*st_params_.sections_per_segment; s++){
+                        state.q(2*s + st_params_.prismatic) = PI*uniform(random);
+                        state.q(2*s + 1 + st_params_.prismatic) = std::abs(state.q(2*s + 1 + st_params_.prismatic));
+                    }
+                }
+                for (int i = 0; i < st_params_.p_size; i++)
+                    p(i) = p_min_ + (p_max_ - p_min_)*(uniform(random) + 1)/2;
+                evaluate(mdl, state, p, &chunk[in_chunk*record]);
+            }
+            if (++in_chunk == chunk_size_){
+                flush(in_chunk);
+                written[thread] += in_chunk;
+                done += in_chunk;
+                in_chunk = 0;
+            }
+        }
+        flush(in_chunk);
+        written[thread] += in_chunk;
+        done += in_chunk;
+        running--;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads_; i++)
+        threads.emplace_back(worker, i);
+    srl::Rate r{1};
+    while (running > 0){
+        r.sleep();
+        fmt::print("{} / {} samples\n", done.load(), n);
+    }
+    for (auto& t : threads)
+        t.join();
+
+    long long int total = 0;
+    for (long long int w : written)
+        total += w;
+    write_manifest(directory, shards, written, replay);
+    fmt::print("wrote {} samples to {}\n", total, directory);
+    return total;
+}
+
+void DatasetGenerator::write_manifest(const std::string& directory, const std::vector<std::string>& shards, const std::vector<long long int>& samples, bool replay) const {
+    YAML::Node manifest;
+    manifest["dtype"] = single_precision_ ? "float32" : "float64";
+    manifest["byte order"] = "little";
+    manifest["record size"] = record_size();
+    manifest["chunk size"] = chunk_size_;
+    int offset = 0;
+    for (const auto& field : fields()){
+        YAML::Node f;
+        f["name"] = field.first;
+        f["offset"] = offset;
+        for (int d : field.second)
+            f["shape"].push_back(d);
+        int n = 1;
+        for (int d : field.second)
+            n *= d;
+        offset += n;
+        manifest["fields"].push_back(f);
+    }
+    for (int i = 0; i < shards.size(); i++){
+        YAML::Node shard;
+        shard["file"] = shards[i];
+        shard["samples"] = samples[i];
+        manifest["shards"].push_back(shard);
+    }
+
+    manifest["robot name"] = st_params_.robot_name;
+    switch (st_params_.model_type){
+        case ModelType::augmentedrigidarm: manifest["model type"] = "augmented"; break;
+        case ModelType::lagrange: manifest["model type"] = "lagrange"; break;
+        case ModelType::neural: manifest["model type"] = "neural"; break;
+    }
+    manifest["coord_type"] = st_params_.coord_type == CoordType::phitheta ? "phitheta" : "thetax";
+    manifest["num segments"] = st_params_.num_segments;
+    manifest["sections per segment"] = st_params_.sections_per_segment;
+    manifest["prismatic"] = st_params_.prismatic;
+    manifest["q size"] = st_params_.q_size;
+    manifest["p size"] = st_params_.p_size;
+    // K, D and A do not depend on the state for the augmented model, so they are not part of the records
+    const DynamicParams& dyn = models_[0]->dyn_;
+    auto flatten = [](const MatrixXd& m){
+        Matrix<double, Dynamic, Dynamic, RowMajor> row_major = m;
+        return std::vector<double>(row_major.data(), row_major.data() + row_major.size());
+    };
+    manifest["K"] = flatten(dyn.K);
+    manifest["D"] = flatten(dyn.D);
+    manifest["A"] = flatten(dyn.A);
+    manifest["A_pseudo"] = flatten(dyn.A_pseudo);
+    manifest["source"] = replay ? "log" : "uniform";
+    if (!replay){
+        manifest["seed"] = seed_;
+        manifest["q range"] = q_range_;
+        manifest["dq range"] = dq_range_;
+        manifest["p min"] = p_min_;
+        manifest["p max"] = p_max_;
+    }
+    manifest["dt"] = dt_;
+    manifest["substep"] = substep_;
+
+    std::ofstream out(directory + "/manifest.yaml");
+    out << manifest;
+}
@@ -0,0 +1,72 @@
+#include "3d-soft-trunk/Executor.h"
+
+Executor::Executor(int num_workers){
+    for (int i = 0; i < std::max(1, num_workers); i++)
+        workers_.emplace_back(&Executor::worker_loop, this);
+    fmt::print("Executor initialized with {} workers.\n", workers_.size());
+}
+
+Executor::~Executor(){
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        run_ = false;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+int Executor::add_task(std::function<void()> step, double hz){
+    assert(hz > 0);
+    std::lock_guard<std::mutex> lock(mtx_);
+    int id = next_id_++;
+    tasks_[id] = Task{std::move(step), (unsigned long long int) (1.0e6/hz)};
+    deadlines_.push({srl::monotonic_us(), id});
+    cv_.notify_all();
+    return id;
+}
+
+void Executor::remove_task(int id){
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [&]{return tasks_.count(id) == 0 || !tasks_[id].running;});
+    tasks_.erase(id); // its entry in deadlines_ is dropped when it comes up
+}
+
+void Executor::worker_loop(){
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (run_){
+        if (deadlines_.empty()){
+            cv_.wait(lock);
+            continue;
+        }
+        Deadline next = deadlines_.top();
+        if (tasks_.count(next.second) == 0){ // removed task
+            deadlines_.pop();
+            continue;
+        }
+        unsigned long long int now = srl::monotonic_us();
+        if (now < next.first){
+            // wake up early if a task with an earlier deadline is added
+            cv_.wait_for(lock, std::chrono::microseconds(next.first - now));
+            continue;
+        }
+        deadlines_.pop();
+        Task& task = tasks_[next.second];
+        task.running = true;
+
+        lock.unlock();
+        task.step();
+        lock.lock();
+
+        task.running = false;
+        // the next deadline is one period later, deadlines which already passed are skipped
+        unsigned long long int deadline = next.first + task.period;
+        now = srl::monotonic_us();
+        if (deadline + task.period < now){
+            missed_deadlines_++;
+            deadline = now;
+        }
+        deadlines_.push({deadline, next.second});
+        cv_.notify_all();
+    }
+}
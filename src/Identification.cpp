@@ -0,0 +1,269 @@
+#include "3d-soft-trunk/Identification.h"
+
+#include <sstream>
+
+ParameterRegressor::ParameterRegressor(const SoftTrunkParameters& st_params, const DynamicParams& dyn) : st_params_(st_params){
+    assert(st_params_.is_finalized());
+    // K, D, A_pseudo of SoftTrunkModel are diagonal per q, divide out the current parameters to get the geometric coefficients
+    k0_ = VectorXd::Zero(st_params_.q_size);
+    d0_ = VectorXd::Zero(st_params_.q_size);
+    a0_ = VectorXd::Zero(st_params_.q_size);
+    for (int i = st_params_.prismatic; i < st_params_.q_size; i++){
+        int segment = (i - st_params_.prismatic) / (2*st_params_.sections_per_segment);
+        k0_(i) = dyn.K(i,i) / st_params_.shear_modulus[segment];
+        d0_(i) = dyn.D(i,i) / st_params_.drag_coef[segment];
+        a0_(i) = dyn.A_pseudo(i, 2*segment + st_params_.prismatic + (i - st_params_.prismatic)%2);
+    }
+    for (int s = 0; s < st_params_.num_segments; s++){
+        const int head = st_params_.prismatic + 2*s*st_params_.sections_per_segment;
+        chamber_config_.push_back(dyn.A.block(head, 3*s + st_params_.prismatic, 2, 3));
+        chamber_config_.back().row(0) /= a0_(head);
+        chamber_config_.back().row(1) /= a0_(head+1);
+    }
+}
+
+void ParameterRegressor::compute(int segment, const VectorXd& rest, const srl::State& state, const VectorXd& p, MatrixXd& Phi, VectorXd& y) const {
+    const int rows = 2*st_params_.sections_per_segment;
+    const int head = st_params_.prismatic + segment*rows;
+    Phi.setZero(rows, num_unknowns);
+    const Vector3d p_Pa = 100*p.segment(3*segment + st_params_.prismatic, 3); // same columns as dyn_.A
+
+    y = -rest.segment(head, rows);
+    for (int r = 0; r < rows; r++){
+        int i = head + r;
+        Phi(r, 0) = k0_(i)*state.q(i);
+        Phi(r, 1) = d0_(i)*state.dq(i);
+        Phi.block(r, 2 + 3*(r%2), 1, 3) = -a0_(i)*p_Pa.transpose(); // x rows use the first row of C, y rows the second
+    }
+}
+
+VectorXd ParameterRegressor::nominal(int segment) const {
+    VectorXd theta = VectorXd::Zero(num_unknowns);
+    theta(0) = st_params_.shear_modulus[segment];
+    theta(1) = st_params_.drag_coef[segment];
+    theta.segment(2, 3) = chamber_config_[segment].row(0).transpose();
+    theta.segment(5, 3) = chamber_config_[segment].row(1).transpose();
+    return theta;
+}
+
+void ParameterRegressor::apply(int segment, const VectorXd& theta, DynamicParams& dyn) const {
+    const int rows = 2*st_params_.sections_per_segment;
+    const int head = st_params_.prismatic + segment*rows;
+    for (int r = 0; r < rows; r++){
+        int i = head + r;
+        dyn.K(i,i) = theta(0)*k0_(i);
+        dyn.D(i,i) = theta(1)*d0_(i);
+        dyn.A.block(i, 3*segment + st_params_.prismatic, 1, 3) = a0_(i)*theta.segment(2 + 3*(r%2), 3).transpose();
+    }
+}
+
+Identification::Identification(const SoftTrunkParameters& st_params, int num_threads) : st_params_(st_params), num_threads_(std::max(1, num_threads)){
+    assert(st_params_.is_finalized());
+    assert(st_params_.model_type == ModelType::augmentedrigidarm); // the geometric coefficients are those of SoftTrunkModel
+    new_params_ = st_params_;
+
+    // the models are created one after another, since each of them writes the URDF file
+    for (int i = 0; i < num_threads_; i++)
+        models_.push_back(std::make_unique<Model>(st_params_));
+
+    regressor_ = std::make_unique<ParameterRegressor>(st_params_, models_[0]->dyn_);
+    fmt::print("Identification initialized with {} threads.\n", num_threads_);
+}
+
+bool read_log(const std::string& filename, const SoftTrunkParameters& st_params, std::vector<double>& t, std::vector<VectorXd>& q, std::vector<VectorXd>& p){
+    std::ifstream file(filename);
+    if (!file.is_open()){
+        fmt::print("could not open {}\n", filename);
+        return false;
+    }
+
+    // find the columns by name
+    std::string line;
+    std::getline(file, line);
+    std::vector<std::string> header;
+    std::stringstream ss(line);
+    std::string column;
+    while (std::getline(ss, column, ',')){
+        column.erase(0, column.find_first_not_of(" "));
+        column.erase(column.find_last_not_of(" \r") + 1);
+        header.push_back(column);
+    }
+    auto find = [&](const std::string& name){
+        return (int) (std::find(header.begin(), header.end(), name) - header.begin());
+    };
+    int t_col = find("timestamp");
+    std::vector<int> q_cols(st_params.q_size);
+    std::vector<int> p_cols(st_params.p_size);
+    for (int i = 0; i < st_params.q_size; i++)
+        q_cols[i] = find(fmt::format("q_{}", i));
+    for (int i = 0; i < st_params.p_size; i++)
+        p_cols[i] = find(fmt::format("p_{}", i));
+    for (int c : q_cols)
+        if (c == header.size()) { fmt::print("{} does not contain q_0..q_{}\n", filename, st_params.q_size-1); return false; }
+    for (int c : p_cols)
+        if (c == header.size()) { fmt::print("{} does not contain p_0..p_{}\n", filename, st_params.p_size-1); return false; }
+    if (t_col == header.size()) { fmt::print("{} does not contain a timestamp\n", filename); return false; }
+
+    t.clear();
+    q.clear();
+    p.clear();
+    std::vector<double> row(header.size());
+    while (std::getline(file, line)){
+        std::stringstream ls(line);
+        int i = 0;
+        while (i < row.size() && std::getline(ls, column, ','))
+            row[i++] = std::atof(column.c_str());
+        if (i < row.size())
+            continue; // incomplete line
+        if (!t.empty() && row[t_col] <= t.back())
+            continue;
+        t.push_back(row[t_col]);
+        q.push_back(VectorXd::Zero(st_params.q_size));
+        p.push_back(VectorXd::Zero(st_params.p_size));
+        for (int j = 0; j < st_params.q_size; j++)
+            q.back()(j) = row[q_cols[j]];
+        for (int j = 0; j < st_params.p_size; j++)
+            p.back()(j) = row[p_cols[j]];
+    }
+    return true;
+}
+
+bool Identification::load_log(const std::string& filename){
+    std::vector<double> t;
+    std::vector<VectorXd> q;
+    std::vector<VectorXd> p;
+    if (!read_log(filename, st_params_, t, q, p))
+        return false;
+
+    // smooth q with a centered moving average, then differentiate with central differences
+    const int n = t.size();
+    const int w = smoothing_window_ / 2;
+    if (n < 2*w + 3){
+        fmt::print("{} contains too few samples\n", filename);
+        return false;
+    }
+    std::vector<VectorXd> q_smooth(n);
+    for (int i = w; i < n - w; i++){
+        q_smooth[i] = VectorXd::Zero(st_params_.q_size);
+        for (int j = -w; j <= w; j++)
+            q_smooth[i] += q[i+j];
+        q_smooth[i] /= 2*w + 1;
+    }
+    std::vector<VectorXd> dq(n);
+    for (int i = w + 1; i < n - w - 1; i++)
+        dq[i] = (q_smooth[i+1] - q_smooth[i-1]) / (t[i+1] - t[i-1]);
+    int added = 0;
+    for (int i = w + 2; i < n - w - 2; i++){
+        srl::State state = st_params_.getBlankState();
+        state.q = q_smooth[i];
+        state.dq = dq[i];
+        state.ddq = (dq[i+1] - dq[i-1]) / (t[i+1] - t[i-1]);
+        state.timestamp = (unsigned long long int) (t[i]*1.0e6);
+        samples_.push_back(state);
+        pressures_.push_back(p[i]);
+        added++;
+    }
+    fmt::print("loaded {} samples from {}\n", added, filename);
+    return true;
+}
+
+void Identification::NormalEquations::add(const NormalEquations& other){
+    AtA += other.AtA;
+    Atb += other.Atb;
+    btb += other.btb;
+    rows += other.rows;
+}
+
+void Identification::NormalEquations::subtract(const NormalEquations& other){
+    AtA -= other.AtA;
+    Atb -= other.Atb;
+    btb -= other.btb;
+    rows -= other.rows;
+}
+
+VectorXd Identification::NormalEquations::solve() const {
+    VectorXd scale = AtA.diagonal().cwiseMax(1e-30).cwiseSqrt().cwiseInverse();
+    MatrixXd scaled = scale.asDiagonal()*AtA*scale.asDiagonal();
+    scaled += 1e-9*MatrixXd::Identity(ParameterRegressor::num_unknowns, ParameterRegressor::num_unknowns); // keeps unexcited unknowns at 0 instead of failing
+    return scale.asDiagonal()*scaled.ldlt().solve(scale.asDiagonal()*Atb);
+}
+
+double Identification::NormalEquations::sse(const VectorXd& x) const {
+    return std::max(0., x.dot(AtA*x) - 2*x.dot(Atb) + btb);
+}
+
+void Identification::identify(int folds){
+    const int n = samples_.size();
+    assert(folds >= 2);
+    if (n < folds){
+        fmt::print("not enough samples to identify the parameters ({})\n", n);
+        return;
+    }
+
+    // accumulate the normal equations of each segment and fold. every thread gets a contiguous range of samples and its own model
+    const int num_segments = st_params_.num_segments;
+    std::vector<std::vector<NormalEquations>> partial(num_threads_, std::vector<NormalEquations>(num_segments*folds));
+    auto worker = [&](int thread){
+        Model& mdl = *models_[thread];
+        MatrixXd Phi;
+        VectorXd y;
+        VectorXd rest;
+        for (int k = n*thread/num_threads_; k < n*(thread+1)/num_threads_; k++){
+            mdl.update(samples_[k], true);
+            int fold = k*folds/n;
+            rest.noalias() = mdl.dyn_.B*samples_[k].ddq;
+            rest += mdl.dyn_.c + mdl.dyn_.g;
+            for (int s = 0; s < num_segments; s++){
+                regressor_->compute(s, rest, samples_[k], pressures_[k], Phi, y);
+                NormalEquations& ne = partial[thread][s*folds + fold];
+                ne.AtA.noalias() += Phi.transpose()*Phi;
+                ne.Atb.noalias() += Phi.transpose()*y;
+                ne.btb += y.squaredNorm();
+                ne.rows += y.size();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads_; i++)
+        threads.emplace_back(worker, i);
+    for (auto& t : threads)
+        t.join();
+
+    fits_.resize(num_segments);
+    for (int s = 0; s < num_segments; s++){
+        std::vector<NormalEquations> fold_ne(folds);
+        NormalEquations total;
+        for (int f = 0; f < folds; f++){
+            for (int i = 0; i < num_threads_; i++)
+                fold_ne[f].add(partial[i][s*folds + f]);
+            total.add(fold_ne[f]);
+        }
+
+        // cross validation: fit on all folds but one, evaluate on the remaining one
+        double sse_validation = 0;
+        int rows_validation = 0;
+        for (int f = 0; f < folds; f++){
+            NormalEquations training = total;
+            training.subtract(fold_ne[f]);
+            sse_validation += fold_ne[f].sse(training.solve());
+            rows_validation += fold_ne[f].rows;
+        }
+
+        VectorXd x = total.solve();
+        SegmentFit& fit = fits_[s];
+        fit.shear_modulus = x(0);
+        fit.drag_coef = x(1);
+        fit.chamber_config << x(2), x(3), x(4), x(5), x(6), x(7);
+        fit.samples = total.rows / (2*st_params_.sections_per_segment);
+        fit.rms_train = sqrt(total.sse(x) / total.rows);
+        fit.rms_validation = sqrt(sse_validation / rows_validation);
+
+        new_params_.shear_modulus[s] = fit.shear_modulus;
+        new_params_.drag_coef[s] = fit.drag_coef;
+        for (int i = 0; i < 6; i++)
+            new_params_.chamberConfigs[6*s+i] = fit.chamber_config(i/3, i%3);
+
+        fmt::print("segment {}: shear modulus {:.0f} (was {:.0f}), drag coef {:.0f} (was {:.0f}), rms residual {:.3e} Nm, cross validated {:.3e} Nm\n",
+            s, fit.shear_modulus, st_params_.shear_modulus[s], fit.drag_coef, st_params_.drag_coef[s], fit.rms_train, fit.rms_validation);
+    }
+}
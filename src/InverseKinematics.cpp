@@ -0,0 +1,104 @@
+#include "3d-soft-trunk/InverseKinematics.h"
+
+InverseKinematics::InverseKinematics(const SoftTrunkParameters& st_params) : st_params_(st_params), kinematics_(st_params), connector_(st_params.lengths[2*st_params.num_segments-1]){
+    assert(st_params_.is_finalized());
+    const double tip = kinematics_.segment_end(st_params_.num_segments-1);
+    kinematics_.set_points({tip - connector_, tip});
+    J_ = MatrixXd::Zero(3, st_params_.q_size);
+}
+
+bool InverseKinematics::solve(const Vector3d& x, VectorXd& q){
+    return solve(x, nullptr, q, max_iterations_);
+}
+
+bool InverseKinematics::solve(const Vector3d& x, const Vector3d& direction, VectorXd& q){
+    return solve(x, &direction, q, max_iterations_);
+}
+
+bool InverseKinematics::solve(const Vector3d& x, const Vector3d* direction, VectorXd& q, int max_iterations){
+    assert(q.size() == st_params_.q_size);
+    assert(!direction || connector_ > 0);
+    const int m = direction ? 6 : 3;
+    MatrixXd J(m, st_params_.q_size);
+    VectorXd e(m);
+    Vector3d d_ref = direction ? direction->normalized() : Vector3d::UnitZ();
+    clamp(q);
+
+    for (iterations_ = 0; ; iterations_++){
+        kinematics_.update(q);
+        e.head(3) = x - kinematics_.position(1);
+        J.topRows(3) = kinematics_.jacobian(1);
+        if (direction){
+            // z axis of the tip is (tip - end of sections)/connector
+            e.tail(3) = direction_weight_*(d_ref - kinematics_.rotation(1).col(2));
+            J.bottomRows(3) = (direction_weight_/connector_)*(kinematics_.jacobian(1) - kinematics_.jacobian(0));
+        }
+        error_ = e.norm();
+        if (error_ < tolerance_ || iterations_ == max_iterations)
+            break;
+
+        MatrixXd JJt = J*J.transpose();
+        JJt.diagonal().array() += damping_*damping_;
+        VectorXd dq = J.transpose()*JJt.ldlt().solve(e);
+        if (dq.norm() > max_step_)
+            dq *= max_step_/dq.norm();
+        VectorXd q_prev = q;
+        q += dq;
+        clamp(q);
+        if ((q - q_prev).norm() < 1e-9) // stuck at the curvature limit
+            break;
+    }
+    J_ = J.topRows(3);
+    return error_ < tolerance_;
+}
+
+int InverseKinematics::solve_batch(const std::vector<Vector3d>& x, const VectorXd& q_init, std::vector<VectorXd>& q, int num_threads, const std::vector<Vector3d>& directions){
+    assert(directions.empty() || directions.size() == x.size());
+    q.resize(x.size());
+    num_threads = std::max(1, std::min<int>(num_threads, x.size()));
+    std::vector<int> failed(num_threads, 0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++){
+        threads.emplace_back([&, t]{
+            InverseKinematics ik = *this; // kinematics are not shared between threads
+            const int begin = t*x.size()/num_threads;
+            const int end = (t+1)*x.size()/num_threads;
+            VectorXd q_warm = q_init;
+            for (int i = begin; i < end; i++){
+                const Vector3d* direction = directions.empty() ? nullptr : &directions[i];
+                if (!ik.solve(x[i], direction, q_warm, (i == begin) ? 10*max_iterations_ : max_iterations_))
+                    failed[t]++;
+                q[i] = q_warm;
+            }
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    int total = 0;
+    for (int f : failed)
+        total += f;
+    return total;
+}
+
+VectorXd InverseKinematics::velocity(const Vector3d& dx) const {
+    Matrix3d JJt = J_*J_.transpose();
+    JJt.diagonal().array() += damping_*damping_;
+    return J_.transpose()*JJt.ldlt().solve(dx);
+}
+
+void InverseKinematics::clamp(VectorXd& q) const {
+    for (int sec = 0; sec < st_params_.num_segments*st_params_.sections_per_segment; sec++){
+        const int segment = sec/st_params_.sections_per_segment;
+        const double max_angle = max_curvature_*st_params_.lengths[2*segment]/st_params_.sections_per_segment;
+        const int i = st_params_.prismatic + 2*sec;
+        if (st_params_.coord_type == CoordType::phitheta){
+            q(i+1) = std::max(-max_angle, std::min(max_angle, q(i+1)));
+        } else {
+            double angle = q.segment(i, 2).norm();
+            if (angle > max_angle)
+                q.segment(i, 2) *= max_angle/angle;
+        }
+    }
+}
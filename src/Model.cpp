@@ -14,6 +14,10 @@ Model::Model(const SoftTrunkParameters& st_params) : st_params_(st_params){
             lag_ = std::make_unique<Lagrange>(st_params_);
             this->dyn_ = lag_->dyn_;
             break;
+        case ModelType::neural:
+            nn_ = std::make_unique<NeuralModel>(st_params_);
+            this->dyn_ = nn_->dyn_;
+            break;
     }
 
     //read in the chamber configurations
@@ -31,7 +35,21 @@ Model::Model(const SoftTrunkParameters& st_params) : st_params_(st_params){
 Model::~Model(){
 }
 
-void Model::update(const srl::State& state){
+bool Model::unchanged(const srl::State& state, const srl::State& last, bool compare_dq) const {
+    if (last.q.size() != state.q.size())
+        return false;
+    if (state.timestamp != 0 && state.timestamp == last.timestamp)
+        return true; // same measurement, no new sensor data
+    if ((state.q - last.q).lpNorm<Infinity>() > st_params_.model_q_threshold)
+        return false;
+    return !compare_dq || (state.dq - last.dq).lpNorm<Infinity>() <= st_params_.model_dq_threshold;
+}
+
+bool Model::update(const srl::State& state, bool force){
+    if (!force && unchanged(state, dynamics_state_, true)){
+        updates_skipped_++;
+        return false;
+    }
     switch (st_params_.model_type){
             case ModelType::augmentedrigidarm: 
                 stm_->set_state(state);
@@ -44,7 +62,33 @@ void Model::update(const srl::State& state){
                 assert (st_params_.coord_type == CoordType::phitheta);
                 assert (st_params_.num_segments == 2);    //lagrange is hardcoded for a 2seg phitheta robot
                 break;
+            case ModelType::neural:
+                nn_->set_state(state);
+                this->dyn_ = nn_->dyn_;
+                break;
         }
+    dyn_.kinematics_timestamp = state.timestamp;
+    dyn_.dynamics_timestamp = state.timestamp;
+    dynamics_state_ = state;
+    kinematics_state_ = state;
+    updates_computed_++;
+    return true;
+}
+
+bool Model::update_kinematics(const srl::State& state, bool force){
+    if (st_params_.model_type != ModelType::augmentedrigidarm)
+        return update(state, force);
+    if (!force && unchanged(state, kinematics_state_, false)){
+        updates_skipped_++;
+        return false;
+    }
+    stm_->set_kinematics(state);
+    dyn_.J = stm_->dyn_.J;
+    dyn_.g = stm_->dyn_.g;
+    dyn_.kinematics_timestamp = state.timestamp;
+    kinematics_state_ = state;
+    updates_computed_++;
+    return true;
 }
 
 VectorXd Model::pseudo2real(VectorXd p_pseudo){
@@ -63,12 +63,17 @@ void AugmentedRigidArm::setup_drake_model()
       Jxi_[i] = MatrixXd::Zero(3, num_joints);
     H_list.resize(st_params.num_segments);
 
-    map_normal2expanded = MatrixXd::Zero(2*st_params.num_segments*(st_params.sections_per_segment + 1)+st_params.prismatic, st_params.q_size);
-    for (int i = 0; i < st_params.num_segments; i++)
-      map_normal2expanded.block(2*i*(st_params.sections_per_segment + 1)+st_params.prismatic, 2*i*st_params.sections_per_segment + st_params.prismatic, 2*st_params.sections_per_segment, 2*st_params.sections_per_segment) = MatrixXd::Identity(2*st_params.sections_per_segment, 2*st_params.sections_per_segment);
-    if (st_params.prismatic){
-      map_normal2expanded(0,0) = 1; //prismatic joint can be taken 1:1
+    for (int i = 0; i < st_params.num_segments; i++){
+      for (int j = 0; j < st_params.sections_per_segment; j++){
+        int expanded_id = i*(st_params.sections_per_segment + 1) + j;
+        q_head_.push_back(2*expanded_id + st_params.prismatic);
+        xi_head_.push_back(5*expanded_id + st_params.prismatic);
+      }
     }
+    B = MatrixXd::Zero(st_params.q_size, st_params.q_size);
+    BJ_ = MatrixXd::Zero(num_joints, st_params.q_size);
+    c = VectorXd::Zero(st_params.q_size);
+    g = VectorXd::Zero(st_params.q_size);
     fmt::print("Finished loading URDF model.\n");
     update_drake_model();
 }
@@ -130,6 +135,19 @@ void AugmentedRigidArm::calculate_m(VectorXd q_)
 }
 
 void AugmentedRigidArm::update_drake_model()
+{
+    update_drake_kinematics();
+    update_drake_dynamics();
+}
+
+void AugmentedRigidArm::update_drake_dynamics()
+{
+    const drake::systems::Context<double> &plant_context = diagram->GetSubsystemContext(*multibody_plant, *diagram_context);
+    multibody_plant->CalcMassMatrix(plant_context, &B_xi_);
+    multibody_plant->CalcBiasTerm(plant_context, &c_xi_);
+}
+
+void AugmentedRigidArm::update_drake_kinematics()
 {
     // update drake model
     drake::systems::Context<double> &plant_context = diagram->GetMutableSubsystemContext(*multibody_plant,
@@ -140,10 +158,6 @@ void AugmentedRigidArm::update_drake_model()
     // update drake visualization
     diagram->ForcedPublish(*diagram_context);
 
-    // update some dynamic & kinematic params
-    multibody_plant->CalcMassMatrix(plant_context, &B_xi_);
-    multibody_plant->CalcBiasTerm(plant_context, &c_xi_);
-
     g_xi_ = - multibody_plant->CalcGravityGeneralizedForces(plant_context);
 
     std::string frame_name;
@@ -379,28 +393,87 @@ void AugmentedRigidArm::update_dJm(const VectorXd &q, const VectorXd &dq)
     //    dJm = (Jxi_delta - Jxi_current) / epsilon;
 }
 
+VectorXd AugmentedRigidArm::expand(const Ref<const VectorXd>& q) const
+{
+    VectorXd q_ = VectorXd::Zero(Jm_.cols());
+    if (st_params.prismatic)
+      q_(0) = q(0); //prismatic joint can be taken 1:1
+    for (int s = 0; s < q_head_.size(); s++)
+      q_.segment(q_head_[s], 2) = q.segment(2*s + st_params.prismatic, 2);
+    return q_;
+}
+
 void AugmentedRigidArm::update(const srl::State &state)
+{
+    update_kinematics(state);
+    update_drake_dynamics();
+    reduce_dynamics();
+    //    update_dJm(state.q,state.dq);
+    //
+}
+
+void AugmentedRigidArm::update_kinematics(const srl::State &state)
 {
     assert(state.q.size() == st_params.q_size);
     assert(state.dq.size() == state.q.size());
 
+    VectorXd q_ = expand(state.q);
     // calculate rigid model pose
-    calculate_m(map_normal2expanded * state.q);
+    calculate_m(q_);
     // calculate Jacobian
-    update_Jm(map_normal2expanded * state.q);
-    dxi_ = Jm_ * map_normal2expanded * state.dq;
-    // calculate dynamic parameters
-    update_drake_model();
+    update_Jm(q_);
+    dxi_.setZero();
+    if (st_params.prismatic)
+      dxi_(0,0) = state.dq(0);
+    for (int s = 0; s < q_head_.size(); s++)
+      dxi_.block(xi_head_[s], 0, 10, 1).noalias() += Jm_.block(xi_head_[s], q_head_[s], 10, 2) * state.dq.segment(2*s + st_params.prismatic, 2);
+    // calculate kinematic parameters and gravity
+    update_drake_kinematics();
     // map to q space
-    B = map_normal2expanded.transpose() * (Jm_.transpose() * B_xi_ * Jm_) * map_normal2expanded;
-    c = map_normal2expanded.transpose() * (Jm_.transpose() * c_xi_);
-    g = map_normal2expanded.transpose() * (Jm_.transpose() * g_xi_);
+    reduce_kinematics();
+}
+
+void AugmentedRigidArm::reduce()
+{
+    reduce_kinematics();
+    reduce_dynamics();
+}
+
+void AugmentedRigidArm::reduce_dynamics()
+{
+    const int P = st_params.prismatic;
+    // the prismatic joint is the first joint of xi_, and only moves it
+    if (P){
+      BJ_.col(0) = B_xi_.col(0);
+      c(0) = c_xi_(0);
+    }
+    for (int s = 0; s < q_head_.size(); s++){
+      const auto Jm_s = Jm_.block(xi_head_[s], q_head_[s], 10, 2);
+      BJ_.middleCols(2*s + P, 2).noalias() = B_xi_.middleCols(xi_head_[s], 10) * Jm_s;
+      c.segment(2*s + P, 2).noalias() = Jm_s.transpose() * c_xi_.segment(xi_head_[s], 10);
+    }
+    if (P)
+      B.row(0) = BJ_.row(0);
+    for (int s = 0; s < q_head_.size(); s++)
+      B.middleRows(2*s + P, 2).noalias() = Jm_.block(xi_head_[s], q_head_[s], 10, 2).transpose() * BJ_.middleRows(xi_head_[s], 10);
+}
+
+void AugmentedRigidArm::reduce_kinematics()
+{
+    const int P = st_params.prismatic;
+    if (P)
+      g(0,0) = g_xi_(0,0);
+    for (int s = 0; s < q_head_.size(); s++)
+      g.block(2*s + P, 0, 2, 1).noalias() = Jm_.block(xi_head_[s], q_head_[s], 10, 2).transpose() * g_xi_.block(xi_head_[s], 0, 10, 1);
+
     for (int i = 0; i < st_params.num_segments; i++){
-      J[i] = Jxi_[i] * Jm_ * map_normal2expanded;
-      J[i].block(1,0,1,st_params.q_size) = -1*J[i].block(1,0,1,st_params.q_size); //correct y axis alignment
+      J[i].resize(3, st_params.q_size);
+      if (P)
+        J[i].col(0) = Jxi_[i].col(0);
+      for (int s = 0; s < q_head_.size(); s++)
+        J[i].middleCols(2*s + P, 2).noalias() = Jxi_[i].middleCols(xi_head_[s], 10) * Jm_.block(xi_head_[s], q_head_[s], 10, 2);
+      J[i].row(1) *= -1; //correct y axis alignment
     }
-    //    update_dJm(state.q,state.dq);
-    //
 }
 
 Eigen::Transform<double, 3, Eigen::Affine> AugmentedRigidArm::get_H(int segment){
@@ -0,0 +1,160 @@
+#include "3d-soft-trunk/Models/NeuralModel.h"
+
+namespace {
+/** @brief read a row major matrix from a flat YAML sequence
+ * @param name key of the node, for the error message
+ * @throws std::runtime_error if the sequence does not have rows*cols elements */
+MatrixXd read_matrix(const YAML::Node& node, const std::string& name, int rows, int cols){
+    std::vector<double> v = node.as<std::vector<double>>();
+    if (v.size() != rows*cols)
+        throw std::runtime_error(fmt::format("NeuralModel: {} has {} elements, expected {}x{}", name, v.size(), rows, cols));
+    return Map<Matrix<double, Dynamic, Dynamic, RowMajor>>(v.data(), rows, cols);
+}
+
+Eigen::VectorXf read_vector(const YAML::Node& node, const std::string& name, int size){
+    std::vector<float> v = node.as<std::vector<float>>();
+    if (v.size() != size)
+        throw std::runtime_error(fmt::format("NeuralModel: {} has {} elements, expected {}", name, v.size(), size));
+    return Map<Eigen::VectorXf>(v.data(), size);
+}
+}
+
+NeuralModel::NeuralModel(const SoftTrunkParameters& st_params) : st_params_(st_params){
+    assert(st_params_.is_finalized());
+    std::string filename = st_params_.neural_weights;
+    if (filename.empty() || filename[0] != '/')
+        filename = fmt::format("{}/config/{}", SOFTTRUNK_PROJECT_DIR, filename);
+    load(filename);
+
+    dyn_.coordtype = st_params_.coord_type;
+    dyn_.B = MatrixXd::Zero(st_params_.q_size, st_params_.q_size);
+    dyn_.c = VectorXd::Zero(st_params_.q_size);
+    dyn_.g = VectorXd::Zero(st_params_.q_size);
+    dyn_.S = MatrixXd::Zero(st_params_.q_size, st_params_.q_size);
+    dyn_.J.resize(st_params_.num_segments, MatrixXd::Zero(3, st_params_.q_size));
+    dyn_.dJ.resize(st_params_.num_segments, MatrixXd::Zero(3, st_params_.q_size));
+    dyn_.x.resize(st_params_.num_segments, Vector3d::Zero());
+    L_ = MatrixXd::Zero(st_params_.q_size, st_params_.q_size);
+
+    set_state(st_params_.getBlankState());
+    fmt::print("NeuralModel initialized from {}, {} layers of up to {} neurons.\n", filename, num_layers(), max_width());
+}
+
+void NeuralModel::load(const std::string& filename){
+    YAML::Node file;
+    try {
+        file = YAML::LoadFile(filename);
+    } catch (const YAML::Exception& e){
+        throw std::runtime_error(fmt::format("NeuralModel: could not read the weights {}: {}", filename, e.what()));
+    }
+    // a wrong weights file would otherwise make the forward pass read out of bounds, so its dimensions are checked in release builds too
+    const int q_size = st_params_.q_size;
+    if (file["q size"].as<int>() != q_size || file["p size"].as<int>() != st_params_.p_size || file["num segments"].as<int>() != st_params_.num_segments)
+        throw std::runtime_error(fmt::format("NeuralModel: {} was trained for q size {}, p size {}, {} segments, but the arm has q size {}, p size {}, {} segments",
+            filename, file["q size"].as<int>(), file["p size"].as<int>(), file["num segments"].as<int>(), q_size, st_params_.p_size, st_params_.num_segments));
+
+    int width = 2*q_size;
+    int max_width = width;
+    for (const auto& layer : file["layers"]){
+        const int rows = layer["rows"].as<int>();
+        const int cols = layer["cols"].as<int>();
+        if (rows < 1 || cols != width)
+            throw std::runtime_error(fmt::format("NeuralModel: layer {} of {} is {}x{}, but its input has {} elements", weights_.size(), filename, rows, cols, width));
+        weights_.push_back(read_matrix(layer["weights"], fmt::format("layer {} weights", weights_.size()), rows, cols).cast<float>());
+        biases_.push_back(read_vector(layer["bias"], fmt::format("layer {} bias", biases_.size()), rows));
+        width = rows;
+        max_width = std::max(max_width, width);
+    }
+    if (weights_.empty())
+        throw std::runtime_error(fmt::format("NeuralModel: {} has no layers", filename));
+    input_mean_ = read_vector(file["input mean"], "input mean", 2*q_size);
+    input_scale_ = read_vector(file["input scale"], "input scale", 2*q_size);
+    output_mean_ = read_vector(file["output mean"], "output mean", width);
+    output_scale_ = read_vector(file["output scale"], "output scale", width);
+
+    int offset = 0;
+    for (const auto& output : file["outputs"]){
+        const std::string name = output["name"].as<std::string>();
+        const int size = output["size"].as<int>();
+        int expected = 0;
+        if (name == "L"){
+            offset_L_ = offset;
+            expected = q_size*(q_size+1)/2;
+        } else if (name == "c"){
+            offset_c_ = offset;
+            expected = q_size;
+        } else if (name == "g"){
+            offset_g_ = offset;
+            expected = q_size;
+        } else if (name == "J"){
+            offset_J_ = offset;
+            expected = 3*q_size*st_params_.num_segments;
+        } else if (name == "residual"){
+            offset_residual_ = offset;
+            expected = q_size;
+        } else {
+            throw std::runtime_error(fmt::format("NeuralModel: unknown output {} in {}", name, filename));
+        }
+        if (size != expected)
+            throw std::runtime_error(fmt::format("NeuralModel: output {} of {} has size {}, expected {}", name, filename, size, expected));
+        offset += size;
+    }
+    if (offset != width)
+        throw std::runtime_error(fmt::format("NeuralModel: the outputs of {} have {} elements in total, but the output layer has {}", filename, offset, width));
+    if (offset_L_ < 0 || offset_g_ < 0 || offset_J_ < 0) // c and the residual may be left out
+        throw std::runtime_error(fmt::format("NeuralModel: {} is missing one of the outputs L, g and J", filename));
+
+    dyn_.K = read_matrix(file["K"], "K", q_size, q_size);
+    dyn_.D = read_matrix(file["D"], "D", q_size, q_size);
+    dyn_.A = read_matrix(file["A"], "A", q_size, st_params_.p_size);
+    dyn_.A_pseudo = read_matrix(file["A_pseudo"], "A_pseudo", q_size, st_params_.p_pseudo_size);
+
+    input_ = Eigen::VectorXf::Zero(2*q_size);
+    act_a_ = Eigen::VectorXf::Zero(max_width);
+    act_b_ = Eigen::VectorXf::Zero(max_width);
+    output_ = Eigen::VectorXf::Zero(width);
+}
+
+void NeuralModel::forward(){
+    Eigen::VectorXf* in = &act_a_;
+    Eigen::VectorXf* out = &act_b_;
+    in->head(input_.size()) = input_;
+    int width = input_.size();
+    const int last = weights_.size() - 1;
+    for (int i = 0; i <= last; i++){
+        const int rows = weights_[i].rows();
+        out->head(rows).noalias() = weights_[i] * in->head(width);
+        out->head(rows) += biases_[i];
+        if (i != last)
+            out->head(rows) = out->head(rows).array().tanh();
+        std::swap(in, out);
+        width = rows;
+    }
+    output_ = in->head(width).cwiseProduct(output_scale_) + output_mean_;
+}
+
+void NeuralModel::set_state(const srl::State &state){
+    const int q_size = st_params_.q_size;
+    input_.head(q_size) = state.q.cast<float>();
+    input_.tail(q_size) = state.dq.cast<float>();
+    input_ = (input_ - input_mean_).cwiseProduct(input_scale_);
+    forward();
+
+    int k = offset_L_;
+    for (int i = 0; i < q_size; i++){
+        for (int j = 0; j < i; j++)
+            L_(i,j) = output_(k++);
+        L_(i,i) = std::exp(output_(k++));
+    }
+    dyn_.B.noalias() = L_ * L_.transpose();
+
+    dyn_.g = output_.segment(offset_g_, q_size).cast<double>();
+    if (offset_c_ >= 0)
+        dyn_.c = output_.segment(offset_c_, q_size).cast<double>();
+    else
+        dyn_.c.setZero();
+    if (offset_residual_ >= 0)
+        dyn_.c += output_.segment(offset_residual_, q_size).cast<double>();
+    for (int s = 0; s < st_params_.num_segments; s++)
+        dyn_.J[s] = Map<const Matrix<float, Dynamic, Dynamic, RowMajor>>(output_.data() + offset_J_ + 3*q_size*s, 3, q_size).cast<double>();
+}
@@ -56,6 +56,15 @@ void SoftTrunkModel::set_state(const srl::State &state)
     xi_ = ara->xi_;
 }
 
+void SoftTrunkModel::set_kinematics(const srl::State &state)
+{
+    ara->update_kinematics(state);
+    assert(state.coordtype == dyn_.coordtype);
+    dyn_.g = ara->g;
+    dyn_.J = ara->J;
+    xi_ = ara->xi_;
+}
+
 
 Eigen::Transform<double, 3, Eigen::Affine> SoftTrunkModel::get_H(int segment_id){
     return ara->get_H(segment_id);
@@ -0,0 +1,113 @@
+#include "3d-soft-trunk/ParameterAdaptation.h"
+
+ParameterAdaptation::ParameterAdaptation(const SoftTrunkParameters& st_params, const DynamicParams& dyn) : st_params_(st_params), regressor_(st_params, dyn), dyn_(dyn){
+    assert(st_params_.is_finalized());
+    assert(st_params_.model_type == ModelType::augmentedrigidarm); // K, D and A are constant only in SoftTrunkModel
+    assert(st_params_.adaptation_forgetting > 0 && st_params_.adaptation_forgetting <= 1);
+
+    for (int s = 0; s < st_params_.num_segments; s++){
+        VectorXd theta = regressor_.nominal(s);
+        VectorXd scale = VectorXd::Ones(ParameterRegressor::num_unknowns);
+        scale(0) = std::abs(theta(0));
+        scale(1) = std::abs(theta(1));
+        scale.segment(2, 3).setConstant(theta.segment(2, 3).norm()); // chamber configurations are scaled by their row, single entries may be close to 0
+        scale.segment(5, 3).setConstant(theta.segment(5, 3).norm());
+        for (int i = 0; i < scale.size(); i++)
+            if (scale(i) < 1e-9) scale(i) = 1;
+        theta_scale_.push_back(scale);
+        theta_.push_back(theta.cwiseQuotient(scale));
+        P_.push_back(initial_covariance_*MatrixXd::Identity(ParameterRegressor::num_unknowns, ParameterRegressor::num_unknowns));
+    }
+    theta_initial_ = theta_;
+
+    adaptation_thread_ = std::thread(&ParameterAdaptation::adaptation_loop, this);
+    fmt::print("ParameterAdaptation initialized with forgetting factor {}.\n", st_params_.adaptation_forgetting);
+}
+
+ParameterAdaptation::~ParameterAdaptation(){
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx_);
+        run_ = false;
+    }
+    queue_cv_.notify_one();
+    adaptation_thread_.join();
+}
+
+void ParameterAdaptation::add_sample(const srl::State& state, const DynamicParams& dyn, const VectorXd& p){
+    Sample sample;
+    sample.state = state;
+    sample.rest.noalias() = dyn.B*state.ddq;
+    sample.rest += dyn.c + dyn.g;
+    sample.p = p;
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx_);
+        if (queue_.size() >= max_queue_size_){
+            queue_.pop_front();
+            samples_dropped_++;
+        }
+        queue_.push_back(std::move(sample));
+    }
+    queue_cv_.notify_one();
+}
+
+std::shared_ptr<const AdaptedParameters> ParameterAdaptation::parameters() const {
+    return std::atomic_load(&parameters_);
+}
+
+void ParameterAdaptation::adaptation_loop(){
+    std::deque<Sample> batch;
+    MatrixXd Phi;
+    VectorXd y;
+    while (true){
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx_);
+            queue_cv_.wait(lock, [this]{return !queue_.empty() || !run_;});
+            if (!run_)
+                return;
+            batch.swap(queue_);
+        }
+
+        for (const Sample& sample : batch){
+            for (int s = 0; s < st_params_.num_segments; s++){
+                regressor_.compute(s, sample.rest, sample.state, sample.p, Phi, y);
+                update(s, Phi, y);
+            }
+            samples_used_++;
+        }
+        batch.clear();
+
+        // publish once per batch, the controller only sees complete sets of parameters
+        auto params = std::make_shared<AdaptedParameters>();
+        params->theta.resize(st_params_.num_segments);
+        for (int s = 0; s < st_params_.num_segments; s++){
+            params->theta[s] = theta_[s].cwiseProduct(theta_scale_[s]);
+            regressor_.apply(s, params->theta[s], dyn_);
+        }
+        params->K = dyn_.K;
+        params->D = dyn_.D;
+        params->A = dyn_.A;
+        params->samples = samples_used_;
+        std::atomic_store(&parameters_, std::shared_ptr<const AdaptedParameters>(std::move(params)));
+    }
+}
+
+void ParameterAdaptation::update(int segment, const MatrixXd& Phi, const VectorXd& y){
+    const double lambda = st_params_.adaptation_forgetting;
+    VectorXd& theta = theta_[segment];
+    MatrixXd& P = P_[segment];
+
+    MatrixXd Phi_scaled = Phi*theta_scale_[segment].asDiagonal();
+    MatrixXd PPhiT = P*Phi_scaled.transpose();
+    MatrixXd S = Phi_scaled*PPhiT;
+    S.diagonal().array() += lambda;
+    MatrixXd gain = S.ldlt().solve(PPhiT.transpose()).transpose();
+
+    theta += gain*(y - Phi_scaled*theta);
+    P -= gain*PPhiT.transpose();
+    P = 0.5*(P + P.transpose());
+    // forget only while the covariance is bounded, otherwise it winds up in directions which are not excited
+    if (P.trace() < initial_covariance_*ParameterRegressor::num_unknowns)
+        P /= lambda;
+
+    theta = theta.cwiseMax((theta_initial_[segment].array() - max_change_).matrix()).cwiseMin((theta_initial_[segment].array() + max_change_).matrix());
+}
@@ -0,0 +1,101 @@
+#include "3d-soft-trunk/RealTime.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <cstring>
+#include <fmt/ranges.h>
+
+namespace {
+    long long int now_ns(){
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec*1000000000LL + ts.tv_nsec;
+    }
+
+    timespec to_timespec(long long int ns){
+        timespec ts;
+        ts.tv_sec = ns / 1000000000LL;
+        ts.tv_nsec = ns % 1000000000LL;
+        return ts;
+    }
+}
+
+bool apply_schedule(const ThreadSchedule& schedule, const std::string& name){
+    bool ok = true;
+    if (!schedule.cpus.empty()){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : schedule.cpus)
+            CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0){
+            fmt::print("could not pin the {} thread to cpus {}: {}\n", name, fmt::join(schedule.cpus, ","), strerror(err));
+            ok = false;
+        }
+    }
+    if (schedule.priority > 0){
+        sched_param param{};
+        param.sched_priority = schedule.priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0){
+            fmt::print("could not set SCHED_FIFO priority {} for the {} thread: {}\n", schedule.priority, name, strerror(err));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool lock_memory(){
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+        fmt::print("could not lock memory: {}\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+RTRate::RTRate(double hz, int spin_us) : period_ns_((long long int) (1.0e9/hz)), spin_ns_(1000LL*spin_us){
+    assert(hz > 0);
+    deadline_ns_ = now_ns();
+}
+
+void RTRate::sleep(){
+    deadline_ns_ += period_ns_;
+    long long int now = now_ns();
+    if (now > deadline_ns_ + period_ns_){
+        // fell behind by more than a period, restart from now instead of running the missed ticks back to back
+        jitter_.overruns += (now - deadline_ns_) / period_ns_;
+        deadline_ns_ = now;
+        return;
+    }
+
+    if (deadline_ns_ - spin_ns_ > now){
+        timespec wake = to_timespec(deadline_ns_ - spin_ns_);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR);
+    }
+    while ((now = now_ns()) < deadline_ns_); // spin for the rest
+
+    double late_us = (now - deadline_ns_)/1000.;
+    jitter_.wakeups++;
+    sum_us_ += late_us;
+    jitter_.mean_us = sum_us_ / jitter_.wakeups;
+    jitter_.max_us = std::max(jitter_.max_us, late_us);
+}
+
+void RTRate::reset_jitter(){
+    jitter_ = Jitter();
+    sum_us_ = 0;
+}
+
+RTRate::Jitter measure_jitter(const ThreadSchedule& schedule, double hz, int spin_us, int wakeups){
+    RTRate::Jitter jitter;
+    std::thread t([&]{
+        apply_schedule(schedule, "jitter test");
+        RTRate r{hz, spin_us};
+        for (int i = 0; i < wakeups; i++)
+            r.sleep();
+        jitter = r.jitter();
+    });
+    t.join();
+    return jitter;
+}
@@ -1,94 +1,200 @@
 #include "3d-soft-trunk/Sensors/BendLabs.h"
 
-BendLabs::BendLabs(const SoftTrunkParameters& st_params) : st_params_(st_params){
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+BendLabs::BendLabs(const SoftTrunkParameters& st_params) : st_params_(st_params), queue_(64, st_params.getBlankState()), log_queue_(256, st_params.getBlankState()){
     assert (st_params_.is_finalized());
 
     state_ = st_params_.getBlankState();
+    bendLab_data_.resize(2*st_params_.num_segments);
+    bendLab_data_prev_.resize(2*st_params_.num_segments);
 
-    serialInterface = std::make_unique<SerialInterface>(st_params_.bendlabs_address,38400);
-    calculatorThread = std::thread(&BendLabs::calculator_loop, this);
+    double frequency = 100.; //bendlabs cannot run faster than 100hz
+    if (st_params_.sensor_refresh_rate < 100.){
+        frequency = st_params_.sensor_refresh_rate;
+    }
+    period_ = 1e6/frequency;
+
+    open_port();
+    epoll_fd_ = epoll_create1(0);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &event);
+    event.data.fd = stop_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, stop_fd_, &event);
+
+    readerThread = std::thread(&BendLabs::reader_loop, this);
+    logThread = std::thread(&BendLabs::log_loop, this);
 
     fmt::print("BendLabs initialized on {}.\n", st_params_.bendlabs_address);
 }
 
 BendLabs::~BendLabs(){
     run = false;
-    calculatorThread.join();
+    uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof(one)) < 0)
+        fmt::print("BendLabs: could not wake up the reader thread\n");
+    readerThread.join();
+    logThread.join();
+    close(stop_fd_);
+    close(epoll_fd_);
+    close(fd_);
+    fmt::print("BendLabs: {} frames received, {} dropped, {} duplicate\n", frames_received_.load(), frames_dropped_.load(), frames_duplicate_.load());
 }
 
-
-void BendLabs::calculator_loop(){
-    std::fstream log_file;
-    std::string filename = "bendlabs_log.csv";
-    fmt::print("logging to {}\n", filename);
-    log_file.open(filename, std::fstream::out);
-    log_file << "timestamp";
-
-    for (int i = 0; i < st_params_.q_size; ++i){
-        log_file << fmt::format(", q_{}", i);
+void BendLabs::open_port(){
+    fd_ = open(st_params_.bendlabs_address.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd_ < 0){
+        fmt::print("BendLabs: could not open {}: {}\n", st_params_.bendlabs_address, strerror(errno));
+        assert(false);
     }
-    log_file << "\n";
 
-    double frequency = 100.; //bendlabs cannot run faster than 100hz
-    if (st_params_.sensor_refresh_rate < 100.){
-        frequency = st_params_.sensor_refresh_rate;
-    }
+    termios tty{};
+    tcgetattr(fd_, &tty);
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B38400);
+    cfsetospeed(&tty, B38400);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(fd_, TCSANOW, &tty);
+    tcflush(fd_, TCIFLUSH); // discard whatever was buffered before we started listening
+}
 
-    unsigned long long int interval;
-    state_prev_ = st_params_.getBlankState();
+bool BendLabs::pop(srl::State& state){
+    return queue_.pop(state);
+}
 
-    srl::Rate r{frequency};
+void BendLabs::reader_loop(){
+    epoll_event events[2];
+    char buffer[256];
+    bool first_line = true;
 
     while(run){
-        r.sleep();
-        timestamp_ += (int) (10e6 / frequency); //timestamp is tracked in us
-        serialInterface->getData(bendLab_data_);
-
-        bool same_as_prev = true;
-        for (int i = 0; i < bendLab_data_.size(); i++){
-            if (bendLab_data_[i] != bendLab_data_prev_[i]) {
-                same_as_prev = false;
+        int n = epoll_wait(epoll_fd_, events, 2, -1);
+        if (n < 0){
+            if (errno == EINTR)
+                continue;
+            fmt::print("BendLabs: epoll_wait failed: {}\n", strerror(errno));
+            return;
+        }
+        for (int i = 0; i < n; i++){
+            if (events[i].data.fd != fd_)
+                continue; // woken up to stop
+
+            ssize_t bytes;
+            while ((bytes = read(fd_, buffer, sizeof(buffer))) > 0){
+                const unsigned long long int received = srl::monotonic_us(); //the sensor has no clock of its own, so stamp the data on reception
+                // lines which arrived in the same read were sent one period apart, so all but the last are back-dated. This also keeps the timestamps strictly increasing
+                int lines_left = std::count(buffer, buffer + bytes, '\n');
+                for (int j = 0; j < bytes; j++){
+                    if (buffer[j] != '\n'){
+                        line_ += buffer[j];
+                        continue;
+                    }
+                    lines_left--;
+                    unsigned long long int timestamp = received - lines_left*period_;
+                    if (timestamp <= last_timestamp_)
+                        timestamp = last_timestamp_ + 1;
+                    last_timestamp_ = timestamp;
+                    if (!first_line) // the first line may have been cut off by the flush
+                        process_line(line_, timestamp);
+                    first_line = false;
+                    line_.clear();
+                }
             }
         }
+    }
+}
 
-        if (same_as_prev){  //assumption that no two datapoints will be same due to noise
-            continue;       //therefore if two concurrent datapoints are equal, there has been no update
+void BendLabs::process_line(const std::string& line, unsigned long long int timestamp){
+    frames_received_++;
+
+    // values are separated by whitespace or commas. The arduino always sends the values of all the sensors it supports, only the first 2*num_segments are used
+    const char* c = line.c_str();
+    char* end;
+    int count = 0;
+    while (true){
+        while (*c == ' ' || *c == '\t' || *c == ',' || *c == '\r')
+            c++;
+        if (*c == '\0')
+            break;
+        float value = strtof(c, &end);
+        if (end == c){
+            count = -1; // not a number
+            break;
         }
+        if (count < bendLab_data_.size())
+            bendLab_data_[count] = value;
+        count++;
+        c = end;
+    }
+    if (count < (int) bendLab_data_.size()){
+        frames_dropped_++;
+        return;
+    }
 
-        interval = timestamp_ - last_timestamp_;
-        last_timestamp_ = timestamp_;
-
-        mtx.lock();
-
-        for (int i = 0; i < st_params_.num_segments; i++){
-            switch (st_params_.coord_type){
-                case CoordType::thetax:
-                    state_.q(2*i+st_params_.prismatic) = bendLab_data_[2*i+1]; //idk why they're mixed up
-                    state_.q(2*i+1+st_params_.prismatic) = bendLab_data_[2*i+0];
-                    break;
-                case CoordType::phitheta:
-                    state_.q(2*i+st_params_.prismatic) = atan2(bendLab_data_[2*i],bendLab_data_[2*i+1]);
-                    state_.q(2*i+1+st_params_.prismatic) = sqrt(pow(bendLab_data_[2*i],2) + pow(bendLab_data_[2*i+1],2));
-                    break;
-            }
-        }
-        if (st_params_.prismatic){
-            state_.q(0) = 0;
+    if (bendLab_data_ == bendLab_data_prev_){  //assumption that no two datapoints will be same due to noise
+        frames_duplicate_++;                    //therefore if two concurrent datapoints are equal, there has been no update
+        return;
+    }
+    bendLab_data_prev_ = bendLab_data_;
+
+    for (int i = 0; i < st_params_.num_segments; i++){
+        switch (st_params_.coord_type){
+            case CoordType::thetax:
+                state_.q(2*i+st_params_.prismatic) = bendLab_data_[2*i+1]; //idk why they're mixed up
+                state_.q(2*i+1+st_params_.prismatic) = bendLab_data_[2*i+0];
+                break;
+            case CoordType::phitheta:
+                state_.q(2*i+st_params_.prismatic) = atan2(bendLab_data_[2*i],bendLab_data_[2*i+1]);
+                state_.q(2*i+1+st_params_.prismatic) = sqrt(pow(bendLab_data_[2*i],2) + pow(bendLab_data_[2*i+1],2));
+                break;
         }
+    }
+    if (st_params_.prismatic){
+        state_.q(0) = 0;
+    }
+    state_.dq.setZero(); //bendlabs has no way of logging time, so set speeds to 0
+    state_.ddq.setZero();
+    state_.timestamp = timestamp;
 
-        state_.dq = (state_.q - state_prev_.q)*0; //bendlabs has no way of logging time, so set speeds to 0
-        state_.ddq = (state_.dq - state_prev_.dq)*0;
-        state_prev_ = state_;
-        state_.timestamp = timestamp_;
+    if (!queue_.push(state_))
+        frames_dropped_++; // the consumer is not keeping up
+    log_queue_.push(state_); // if the log thread falls behind, the frame is only missing from the log
+}
+
+void BendLabs::log_loop(){
+    std::fstream log_file;
+    std::string filename = "bendlabs_log.csv";
+    fmt::print("logging to {}\n", filename);
+    log_file.open(filename, std::fstream::out);
+    log_file << "timestamp";
 
-        mtx.unlock();
+    for (int i = 0; i < st_params_.q_size; ++i){
+        log_file << fmt::format(", q_{}", i);
+    }
+    log_file << "\n";
 
-        log_file << timestamp_;
-        for (int i = 0; i < 2 * st_params_.q_size; ++i){
-            log_file << fmt::format(", {}", state_.q(i));
+    srl::State state = st_params_.getBlankState();
+    srl::Rate r{10};
+    while(run){
+        r.sleep();
+        while (log_queue_.pop(state)){
+            log_file << state.timestamp;
+            for (int i = 0; i < st_params_.q_size; ++i){
+                log_file << fmt::format(", {}", state.q(i));
+            }
+            log_file << "\n";
         }
-        double phi, theta;
-        log_file << "\n";
     }
     log_file.close();
-}
\ No newline at end of file
+}
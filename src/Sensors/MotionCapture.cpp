@@ -1,9 +1,9 @@
 #include "3d-soft-trunk/Sensors/MotionCapture.h"
 
-MotionCapture::MotionCapture(const SoftTrunkParameters& st_params) : st_params_(st_params){
+MotionCapture::MotionCapture(const SoftTrunkParameters& st_params) : st_params_(st_params), snapshot_(st_params.getBlankState()), log_queue_(1024, st_params.getBlankState()){
     assert(st_params.is_finalized());
 
-    //initialize transformation vector to also contain objects    
+    //initialize transformation vector to also contain objects
     abs_transforms_.resize(st_params_.num_segments + 1 + st_params_.objects + st_params_.prismatic);
 
     //initialize client
@@ -11,14 +11,27 @@ MotionCapture::MotionCapture(const SoftTrunkParameters& st_params) : st_params_(
     optiTrackClient = std::make_unique<QualisysClient>(st_params.num_segments + 1 + st_params_.prismatic + st_params_.objects, emptyCameraList, "6D", true);
 
     state_ = st_params_.getBlankState();
+    q_ = state_.q;
+    dq_ = state_.dq;
+    objects_ = state_.objects;
+
+    Matrix3d rot;
+    rot << 0, 0, -1, 0, 1, 0, 1, 0, 0; //this matrix rotates the base frame into the desired orientation;
+    Matrix3d rot_trans;
+    rot_trans << -1, 0, 0, 0, 1, 0, 0, 0, -1;
+    base_rotation_ = rot*rot_trans;
+    body_rotation_ = rot;
 
     calculatorThread = std::thread(&MotionCapture::calculator_loop, this);
+    logThread = std::thread(&MotionCapture::log_loop, this);
     fmt::print("Motion Capture initialized with {} extra objects.\n", st_params_.objects);
 }
 
 MotionCapture::~MotionCapture(){
     run_ = false;
     calculatorThread.join();
+    logThread.join();
+    fmt::print("Motion Capture: {} frames received, {} dropped, {} partial\n", frames_received_.load(), frames_dropped_.load(), frames_partial_.load());
 }
 
 Eigen::Transform<double, 3, Eigen::Affine> MotionCapture::get_frame(int id){
@@ -26,114 +39,162 @@ Eigen::Transform<double, 3, Eigen::Affine> MotionCapture::get_frame(int id){
     return abs_transforms_[id];
 }
 
+bool MotionCapture::latest(srl::State& state){
+    return snapshot_.read(state);
+}
 
-void MotionCapture::calculator_loop(){
-    std::fstream log_file;
-    
-    std::string filename = "qualisys_log.csv";
-    fmt::print("logging to {}\n", filename);
-    log_file.open(filename, std::fstream::out);
-    log_file << "timestamp";
-    for (int i = 0; i < st_params_.q_size; ++i)
-        log_file << fmt::format(", q_{}", i);
-    log_file << "\n";
-
+void MotionCapture::update_clock_offset(unsigned long long int now, long long int offset){
+    // sliding window minimum: an offset which arrived earlier and is not smaller can never be the minimum again
+    const int capacity = offset_window_.size();
+    auto at = [&](int i) -> std::pair<unsigned long long int, long long int>& { return offset_window_[(window_start_ + i) % capacity]; };
+    while (window_count_ > 0 && at(window_count_ - 1).second >= offset)
+        window_count_--;
+    if (window_count_ == capacity){ // more frames than expected in the window, forget the oldest
+        window_start_ = (window_start_ + 1) % capacity;
+        window_count_--;
+    }
+    at(window_count_++) = {now, offset};
+    const unsigned long long int window = clock_window_*1.0e6;
+    while (now - at(0).first > window){ // the newest entry is never older than the window
+        window_start_ = (window_start_ + 1) % capacity;
+        window_count_--;
+    }
+    clock_offset_ = at(0).second;
+}
 
-    srl::State state_prev_ = st_params_.getBlankState();
+void MotionCapture::set_callback(std::function<void(const srl::State&)> callback){
+    std::lock_guard<std::mutex> lock(callback_mtx_);
+    callback_ = callback;
+}
 
+void MotionCapture::calculator_loop(){
     double frequency = 500.;
     if (st_params_.sensor_refresh_rate < 500.){     //qualisys max refresh rate is 500hz
-        frequency = st_params_.sensor_refresh_rate;                           
+        frequency = st_params_.sensor_refresh_rate;
     }
     srl::Rate rate{frequency};
-
-    run_ = true;
-    double interval_measured; // actual measured interval between timesteps
+    unsigned long long int polled_timestamp = 0;
+    offset_window_.resize((int) (clock_window_*frequency) + 2);
 
     while(run_){
         rate.sleep();
         optiTrackClient->getData(abs_transforms_, timestamp_);
 
-        // if ANY of the frames has not been received, disregard the entire data.
-        bool all_frames_received = true;
-        for (int i=0; i<st_params_.num_segments+1; i++){
-            if (std::isnan(abs_transforms_[i](0,0)))
-                all_frames_received = false;
-        }
-        if (!all_frames_received)
-            continue;
-
         // ignore if current timestep is same as previous
-        if (last_timestamp_ == timestamp_)
+        if (polled_timestamp == timestamp_)
             continue;
-        interval_measured = (timestamp_ - last_timestamp_) / 1.0e6;
-        last_timestamp_ = timestamp_;
-
-        double phi, theta;
-        MatrixXd matrix;
-
+        polled_timestamp = timestamp_;
+        frames_received_++;
 
-        mtx.lock(); //ensure that while the state is being changed nothing is getting pulled
+        // map the QTM timestamp onto the monotonic clock shared by all sensors
+        const unsigned long long int now = srl::monotonic_us();
+        update_clock_offset(now, (long long int) now - (long long int) timestamp_);
 
-        Matrix3d rot;
-        rot << 0, 0, -1, 0, 1, 0, 1, 0, 0; //this matrix rotates the base frame into the desired orientation;
-        Matrix3d rot_trans;
-        rot_trans << -1, 0, 0, 0, 1, 0, 0, 0, -1;
-        for (int i = st_params_.num_segments + st_params_.prismatic; i >= 0; i--){
-            //make translation relative to base frame and align orientation correctly
-            abs_transforms_[i].translation() = rot*rot_trans*(abs_transforms_[i].translation() - abs_transforms_[0].translation());
-            //bring rotation into desired orientation
-            abs_transforms_[i].matrix().block(0,0,3,3) = abs_transforms_[i].matrix().block(0,0,3,3)*rot;
+        if (!process_frame()){
+            frames_dropped_++;
+            continue;
         }
 
-        for (int i = 0; i < st_params_.num_segments; i++) {
-            matrix = (abs_transforms_[i + st_params_.prismatic].inverse() * abs_transforms_[i + 1 + st_params_.prismatic]).matrix();
-            // calculates phi, theta based on orientation w.r.t z-axis
-            phi = atan2(matrix(1, 2), matrix(0, 2));
-            theta = acos(matrix(2,2));
-
-            //convert to desired coordinate type
-            switch (st_params_.coord_type) {
-                case CoordType::phitheta:
-                    state_.q(2*i+st_params_.prismatic) = phi;
-                    state_.q(2*i+1+st_params_.prismatic) = theta;
-                    break;
-                case CoordType::thetax:
-                    state_.q(2*i+st_params_.prismatic) = -cos(phi) * theta;
-                    state_.q(2*i+1+st_params_.prismatic) = -sin(phi) * theta;
-                    break;
-            }
-            if (st_params_.prismatic){
-                state_.q(0) = (abs_transforms_[0].translation()-abs_transforms_[1].translation()).norm();
-            }
-        }     
-
-        
-
-        //derivatives are evaluated numerically
-        state_.dq = (state_.q - state_prev_.q) / interval_measured;
-        state_.ddq = (state_.dq - state_prev_.dq) / interval_measured;
-        state_.timestamp = timestamp_;
-
-        // all transforms belonging to the arm go into the tip transform vector
-        for (int i = 0; i < st_params_.num_segments + 1 + st_params_.prismatic; i++){
-            state_.tip_transforms[i] = abs_transforms_[i];
+        snapshot_.back() = state_;
+        snapshot_.publish();
+        log_queue_.push(state_); // if the log thread falls behind, the frame is only missing from the log
+        {
+            std::lock_guard<std::mutex> lock(callback_mtx_);
+            if (callback_)
+                callback_(state_);
         }
+    }
+}
+
+bool MotionCapture::process_frame(){
+    const int arm_bodies = st_params_.num_segments + 1 + st_params_.prismatic;
+
+    // the arm state needs every body of the arm
+    for (int i = 0; i < arm_bodies; i++){
+        if (std::isnan(abs_transforms_[i](0,0)))
+            return false;
+    }
+    // an occluded object keeps its last seen transform
+    bool all_objects_received = true;
+    for (int i = 0; i < st_params_.objects; i++){
+        if (std::isnan(abs_transforms_[arm_bodies + i](0,0)))
+            all_objects_received = false;
+        else
+            objects_[i] = abs_transforms_[arm_bodies + i];
+    }
+    if (!all_objects_received)
+        frames_partial_++;
+
+    const double interval_measured = (timestamp_ - last_timestamp_) / 1.0e6; // actual measured interval between timesteps
+    last_timestamp_ = timestamp_;
+
+    // all transforms belonging to the arm go into the tip transform vector
+    const Vector3d base = abs_transforms_[0].translation();
+    for (int i = 0; i < arm_bodies; i++){
+        //make translation relative to base frame and align orientation correctly
+        state_.tip_transforms[i].translation() = base_rotation_*(abs_transforms_[i].translation() - base);
+        //bring rotation into desired orientation
+        state_.tip_transforms[i].linear() = abs_transforms_[i].linear()*body_rotation_;
+    }
 
-        //objects to object vector
-        for (int i = 0; i < st_params_.objects; i++){
-            state_.objects[i] = abs_transforms_[st_params_.num_segments + 1 + st_params_.prismatic + i];
+    for (int i = 0; i < st_params_.num_segments; i++) {
+        // orientation of the segment tip w.r.t. the segment base, only its z axis is needed
+        const Vector3d z = state_.tip_transforms[i + st_params_.prismatic].linear().transpose() * state_.tip_transforms[i + 1 + st_params_.prismatic].linear().col(2);
+        // calculates phi, theta based on orientation w.r.t z-axis
+        const double phi = atan2(z(1), z(0));
+        const double theta = acos(std::max(-1., std::min(1., z(2))));
+
+        //convert to desired coordinate type
+        switch (st_params_.coord_type) {
+            case CoordType::phitheta:
+                q_(2*i+st_params_.prismatic) = phi;
+                q_(2*i+1+st_params_.prismatic) = theta;
+                break;
+            case CoordType::thetax:
+                q_(2*i+st_params_.prismatic) = -cos(phi) * theta;
+                q_(2*i+1+st_params_.prismatic) = -sin(phi) * theta;
+                break;
         }
+    }
+    if (st_params_.prismatic){
+        q_(0) = state_.tip_transforms[1].translation().norm();
+    }
 
-        mtx.unlock(); //unlock the mutex after modifying state
+    //derivatives are evaluated numerically
+    dq_ = (q_ - state_.q) / interval_measured;
+    state_.ddq = (dq_ - state_.dq) / interval_measured;
+    state_.dq = dq_;
+    state_.q = q_;
+    state_.timestamp = timestamp_ + clock_offset_;
 
-        state_prev_ = state_;
+    //objects to object vector
+    for (int i = 0; i < st_params_.objects; i++){
+        state_.objects[i] = objects_[i];
+    }
+    return true;
+}
 
+void MotionCapture::log_loop(){
+    std::fstream log_file;
 
-        log_file << timestamp_;
-        for (int i = 0; i < 2 * st_params_.num_segments; ++i)
-            log_file << fmt::format(", {}", state_.q(i));
-        log_file << "\n";
+    std::string filename = "qualisys_log.csv";
+    fmt::print("logging to {}\n", filename);
+    log_file.open(filename, std::fstream::out);
+    log_file << "timestamp";
+    for (int i = 0; i < st_params_.q_size; ++i)
+        log_file << fmt::format(", q_{}", i);
+    log_file << "\n";
+
+    srl::State state = st_params_.getBlankState();
+    srl::Rate r{10};
+    while(run_){
+        r.sleep();
+        while (log_queue_.pop(state)){
+            log_file << state.timestamp;
+            for (int i = 0; i < st_params_.q_size; ++i)
+                log_file << fmt::format(", {}", state.q(i));
+            log_file << "\n";
+        }
     }
     log_file.close();
 }
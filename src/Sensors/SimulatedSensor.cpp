@@ -0,0 +1,139 @@
+#include "3d-soft-trunk/Sensors/SimulatedSensor.h"
+
+SimulatedSensor::SimulatedSensor(const SoftTrunkParameters& st_params) : st_params_(st_params), config_(st_params.simulated_sensor), kinematics_(st_params),
+    pressure_(VectorXd::Zero(st_params.p_size)), in_flight_(std::max(1, (int) std::ceil(st_params.simulated_sensor.latency*st_params.sensor_refresh_rate)) + 1, st_params.getBlankState()),
+    snapshot_(st_params.getBlankState()), random_(st_params.simulated_sensor.seed){
+    assert(st_params_.is_finalized());
+    assert(0 <= config_.dropout && config_.dropout < 1);
+
+    mdl_ = std::make_unique<Model>(st_params_);
+    truth_ = st_params_.getBlankState();
+    measured_ = st_params_.getBlankState();
+    state_ = st_params_.getBlankState();
+    state_prev_ = st_params_.getBlankState();
+    p_ = VectorXd::Zero(st_params_.p_size);
+
+    // frames of the motion capture: the base, the prismatic joint and the tip of each segment
+    std::vector<double> arc_lengths;
+    if (st_params_.prismatic)
+        arc_lengths.push_back(0);
+    for (int i = 0; i < st_params_.num_segments; i++)
+        arc_lengths.push_back(kinematics_.segment_end(i));
+    kinematics_.set_points(arc_lengths);
+    state_.tip_transforms[0] = Eigen::Transform<double, 3, Eigen::Affine>::Identity();
+    state_.tip_transforms[0].linear() = Eigen::AngleAxisd(st_params_.armAngle*PI/180, Vector3d::UnitY()).toRotationMatrix();
+    for (auto& object : state_.objects)
+        object = Eigen::Transform<double, 3, Eigen::Affine>::Identity();
+
+    physicsThread = std::thread(&SimulatedSensor::physics_loop, this);
+    fmt::print("Simulated sensor initialized, noise {}, latency {}s, dropout {}, quantization {}.\n", config_.noise, config_.latency, config_.dropout, config_.quantization);
+}
+
+SimulatedSensor::~SimulatedSensor(){
+    run_ = false;
+    physicsThread.join();
+}
+
+bool SimulatedSensor::latest(srl::State& state){
+    return snapshot_.read(state);
+}
+
+void SimulatedSensor::set_pressure(const VectorXd& p){
+    assert(p.size() == st_params_.p_size);
+    pressure_.back() = p;
+    pressure_.publish();
+}
+
+srl::State SimulatedSensor::ground_truth(){
+    std::lock_guard<std::mutex> lock(truth_mtx_);
+    return truth_;
+}
+
+void SimulatedSensor::physics_loop(){
+    RTRate r{physics_rate_};
+    const unsigned long long int sample_interval = 1.0e6/st_params_.sensor_refresh_rate;
+    const unsigned long long int latency = config_.latency*1.0e6;
+    unsigned long long int last_step = srl::monotonic_us();
+    unsigned long long int next_sample = last_step;
+
+    while(run_){
+        r.sleep();
+        unsigned long long int now = srl::monotonic_us();
+        // follow the wall clock, so the arm moves in real time even if a step was late. Longer gaps are not caught up
+        integrate(std::min((now - last_step)/1.0e6, 4./physics_rate_));
+        last_step = now;
+
+        if (now >= next_sample){
+            sample(now);
+            next_sample += sample_interval;
+            if (next_sample <= now) // fell behind by more than a sample
+                next_sample = now + sample_interval;
+        }
+        while (in_flight_.front() && in_flight_.front()->timestamp + latency <= now){
+            in_flight_.pop(measured_);
+            deliver(measured_);
+        }
+    }
+}
+
+void SimulatedSensor::integrate(double h){
+    pressure_.read(p_);
+    mdl_->update(truth_);
+    const DynamicParams& dyn = mdl_->dyn_;
+
+    LDLT<MatrixXd> B_ldlt = dyn.B.ldlt();
+    const VectorXd b_inv_rest = B_ldlt.solve(dyn.A * 100*p_ - dyn.c - dyn.g); //convert from mbar
+    const MatrixXd b_inv_k = B_ldlt.solve(dyn.K);
+    const MatrixXd b_inv_d = B_ldlt.solve(dyn.D);
+
+    std::lock_guard<std::mutex> lock(truth_mtx_);
+    const double step = 0.00001;
+    for (double t = 0; t < h; t += step){ //semi-implicit euler with high resolution
+        const double dt = std::min(step, h - t);
+        truth_.ddq = b_inv_rest - b_inv_k * truth_.q - b_inv_d * truth_.dq;
+        truth_.dq += dt * truth_.ddq;
+        truth_.q += dt * truth_.dq;
+    }
+    truth_.timestamp = srl::monotonic_us();
+}
+
+void SimulatedSensor::sample(unsigned long long int t){
+    samples_taken_++;
+    if (config_.dropout > 0 && uniform_(random_) < config_.dropout){
+        samples_dropped_++;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(truth_mtx_);
+        measured_.q = truth_.q;
+    }
+    if (config_.noise > 0)
+        for (int i = 0; i < st_params_.q_size; i++)
+            measured_.q(i) += config_.noise * noise_(random_);
+    if (config_.quantization > 0)
+        measured_.q = (measured_.q / config_.quantization).array().round() * config_.quantization;
+    measured_.timestamp = t;
+    if (!in_flight_.push(measured_))
+        samples_dropped_++; // can only happen if the physics thread stalled for longer than the latency
+}
+
+void SimulatedSensor::deliver(const srl::State& measured){
+    //derivatives are evaluated numerically, as for the motion capture
+    if (state_prev_.timestamp != 0){
+        const double interval = (measured.timestamp - state_prev_.timestamp) / 1.0e6;
+        state_.dq = (measured.q - state_prev_.q) / interval;
+        state_.ddq = (state_.dq - state_prev_.dq) / interval;
+    }
+    state_.q = measured.q;
+    state_.timestamp = measured.timestamp;
+
+    kinematics_.update(state_.q, false);
+    for (int k = 0; k < kinematics_.num_points(); k++)
+        state_.tip_transforms[k + 1] = kinematics_.pose(k);
+
+    snapshot_.back() = state_;
+    snapshot_.publish();
+    state_prev_.q = state_.q;
+    state_prev_.dq = state_.dq;
+    state_prev_.timestamp = state_.timestamp;
+}
@@ -0,0 +1,116 @@
+#include "3d-soft-trunk/StateBuffer.h"
+
+StateBuffer::StateBuffer(const SoftTrunkParameters& st_params, int capacity) : st_params_(st_params){
+    assert(st_params_.is_finalized());
+    assert(capacity > 1);
+    buffer_.resize(capacity);
+    for (int i = 0; i < capacity; i++){
+        buffer_[i] = st_params_.getBlankState();
+    }
+}
+
+bool StateBuffer::push(const srl::State& state){
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count_ > 0 && state.timestamp <= at(count_-1).timestamp)
+        return false;
+    buffer_[head_] = state;
+    head_ = (head_ + 1) % buffer_.size();
+    if (count_ < buffer_.size())
+        count_++;
+    return true;
+}
+
+const srl::State& StateBuffer::at(int i) const {
+    assert(0 <= i && i < count_);
+    return buffer_[(head_ - count_ + i + buffer_.size()) % buffer_.size()];
+}
+
+bool StateBuffer::state_at(unsigned long long int t, srl::State& state) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count_ == 0)
+        return false;
+
+    if (t >= at(count_-1).timestamp){
+        extrapolate(at(count_-1), (t - at(count_-1).timestamp)/1.0e6, state);
+        return true;
+    }
+    if (t <= at(0).timestamp){
+        state = at(0);
+        return true;
+    }
+
+    // binary search for the first sample newer than t
+    int lo = 0;
+    int hi = count_ - 1;
+    while (hi - lo > 1){
+        int mid = (lo + hi) / 2;
+        if (at(mid).timestamp <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const srl::State& a = at(lo);
+    const srl::State& b = at(hi);
+    interpolate(a, b, (double) (t - a.timestamp) / (b.timestamp - a.timestamp), state);
+    state.timestamp = t;
+    return true;
+}
+
+bool StateBuffer::latest(srl::State& state) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count_ == 0)
+        return false;
+    state = at(count_-1);
+    return true;
+}
+
+unsigned long long int StateBuffer::newest_timestamp() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count_ == 0 ? 0 : at(count_-1).timestamp;
+}
+
+unsigned long long int StateBuffer::oldest_timestamp() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count_ == 0 ? 0 : at(0).timestamp;
+}
+
+int StateBuffer::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count_;
+}
+
+void StateBuffer::clear(){
+    std::lock_guard<std::mutex> lock(mtx);
+    head_ = 0;
+    count_ = 0;
+}
+
+/** @brief interpolate between two transforms, translation linearly and rotation with slerp */
+Eigen::Transform<double, 3, Eigen::Affine> interpolate_transform(const Eigen::Transform<double, 3, Eigen::Affine>& a, const Eigen::Transform<double, 3, Eigen::Affine>& b, double r){
+    Eigen::Transform<double, 3, Eigen::Affine> out = Eigen::Transform<double, 3, Eigen::Affine>::Identity();
+    Quaterniond qa(a.rotation());
+    Quaterniond qb(b.rotation());
+    out.linear() = qa.slerp(r, qb).toRotationMatrix();
+    out.translation() = (1-r)*a.translation() + r*b.translation();
+    return out;
+}
+
+void StateBuffer::interpolate(const srl::State& a, const srl::State& b, double r, srl::State& state) const {
+    state = a;
+    state.q = (1-r)*a.q + r*b.q;
+    state.dq = (1-r)*a.dq + r*b.dq;
+    state.ddq = (1-r)*a.ddq + r*b.ddq;
+    for (int i = 0; i < state.tip_transforms.size() && i < b.tip_transforms.size(); i++)
+        state.tip_transforms[i] = interpolate_transform(a.tip_transforms[i], b.tip_transforms[i], r);
+    for (int i = 0; i < state.objects.size() && i < b.objects.size(); i++)
+        state.objects[i] = interpolate_transform(a.objects[i], b.objects[i], r);
+}
+
+void StateBuffer::extrapolate(const srl::State& a, double dt, srl::State& state) const {
+    state = a;
+    state.timestamp = a.timestamp + (unsigned long long int) (dt*1.0e6);
+    dt = std::min(dt, max_extrapolation_);
+    // the transforms are not extrapolated since the sensors do not provide their velocities
+    state.q = a.q + a.dq*dt + 0.5*a.ddq*dt*dt;
+    state.dq = a.dq + a.ddq*dt;
+}
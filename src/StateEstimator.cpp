@@ -7,6 +7,7 @@ StateEstimator::StateEstimator(const SoftTrunkParameters& st_params) : st_params
 
     for (int i = 0; i < all_states_.size(); i++){
         all_states_[i] = st_params_.getBlankState();
+        buffers_.push_back(std::make_unique<StateBuffer>(st_params_));
     }
 
     for (int i = 0; i < sensors_.size(); i++){
@@ -19,6 +20,9 @@ StateEstimator::StateEstimator(const SoftTrunkParameters& st_params) : st_params
             break;
         case SensorType::simulator:
             break;
+        case SensorType::simulated:
+            simulated_ = std::make_unique<SimulatedSensor>(st_params_);
+            break;
         }
     }
 
@@ -34,22 +38,47 @@ void StateEstimator::poll_sensors(){
 }
 
 void StateEstimator::get_states(){
+    srl::State newest = st_params_.getBlankState();
     for (int i = 0; i < all_states_.size(); i++){
         switch (sensors_[i]){
             case SensorType::qualisys:
-                all_states_[i] = mocap_->state_;
-                assert(all_states_[i].coordtype==st_params_.coord_type);
+                if (!mocap_->latest(newest))
+                    continue; // no new frame
                 break;
-            case SensorType::bendlabs:
-                all_states_[i] = bendlabs_->state_;
-                assert(all_states_[i].coordtype==st_params_.coord_type);
+            case SensorType::simulated:
+                if (!simulated_->latest(newest))
+                    continue;
                 break;
+            case SensorType::bendlabs:
+                // buffer every frame received since the last poll, not only the newest
+                while (bendlabs_->pop(newest))
+                    buffers_[i]->push(newest);
+                continue;
             case SensorType::simulator:
-                break;
+                continue;
         }
+        assert(newest.coordtype==st_params_.coord_type);
+        if (newest.timestamp != 0)
+            buffers_[i]->push(newest); // ignored if it is the same sample as last time
+    }
+
+    // align all sensors to the newest sample received from any sensor
+    unsigned long long int t = 0;
+    for (int i = 0; i < buffers_.size(); i++){
+        t = std::max(t, buffers_[i]->newest_timestamp());
+    }
+    for (int i = 0; i < all_states_.size(); i++){
+        if (sensors_[i] == SensorType::simulator)
+            continue;
+        buffers_[i]->state_at(t, all_states_[i]);
     }
 }
 
+bool StateEstimator::state_at(unsigned long long int t, srl::State& state, int sensor){
+    assert(0 <= sensor && sensor < buffers_.size());
+    return buffers_[sensor]->state_at(t, state);
+}
+
 void StateEstimator::get_filtered_state(){
     /** depending on filter complexity, make an object to poll for filter output and hand it all states */
     
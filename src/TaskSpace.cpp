@@ -0,0 +1,52 @@
+#include "3d-soft-trunk/TaskSpace.h"
+
+void TaskSpace::update(const MatrixXd& J){
+    assert(J.rows() == 3);
+    J_ = J;
+    Matrix3d JJT;
+    JJT.noalias() = J_*J_.transpose();
+    SelfAdjointEigenSolver<Matrix3d> eig(JJT);
+    eigenvalues_ = eig.eigenvalues().cwiseMax(0); // round off may make them slightly negative
+    eigenvectors_ = eig.eigenvectors();
+    has_inertia_ = false;
+}
+
+void TaskSpace::update(const MatrixXd& J, const MatrixXd& B){
+    update(J);
+    B_ldlt_.compute(B);
+    B_inv_JT_ = B_ldlt_.solve(J_.transpose());
+    Matrix3d JBJT;
+    JBJT.noalias() = J_*B_inv_JT_;
+    SelfAdjointEigenSolver<Matrix3d> eig(JBJT);
+    // invert in the eigenbasis, directions which J cannot reach get no inertia instead of an infinite one
+    Vector3d mu = eig.eigenvalues();
+    Vector3d mu_inv = Vector3d::Zero();
+    for (int i = 0; i < 3; i++)
+        if (mu(i) > 1e-12*mu(2)) mu_inv(i) = 1./mu(i);
+    operational_inertia_.noalias() = eig.eigenvectors()*mu_inv.asDiagonal()*eig.eigenvectors().transpose();
+    has_inertia_ = true;
+}
+
+MatrixXd TaskSpace::damped_pinv(double e, double lambda) const {
+    // with J = U S V^T, the damped pseudoinverse V S_damped U^T equals J^T U diag(1/(s^2 + damp)) U^T, where U and s^2 come from J J^T
+    Vector3d weights;
+    for (int i = 0; i < 3; i++){
+        double s2 = eigenvalues_(i);
+        double damp = 0;
+        if (s2 < e*e)
+            damp = (1 - s2/(e*e))*lambda*lambda;
+        weights(i) = (s2 + damp > 0) ? 1./(s2 + damp) : 0;
+    }
+    return J_.transpose()*(eigenvectors_*weights.asDiagonal()*eigenvectors_.transpose());
+}
+
+const Matrix3d& TaskSpace::operational_inertia() const {
+    assert(has_inertia_);
+    return operational_inertia_;
+}
+
+double TaskSpace::singularity_measure() const {
+    if (eigenvalues_(2) <= 0)
+        return 0;
+    return sqrt(eigenvalues_(3 - std::min<int>(3, J_.cols())) / eigenvalues_(2));
+}
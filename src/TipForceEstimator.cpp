@@ -0,0 +1,52 @@
+#include "3d-soft-trunk/TipForceEstimator.h"
+
+TipForceEstimator::TipForceEstimator(const SoftTrunkParameters& st_params) : st_params_(st_params){
+    assert(st_params_.is_finalized());
+    segment_ = st_params_.num_segments - 1; // DynamicParams::J has one jacobian per segment, also for prismatic arms
+    tau_res_ = VectorXd::Zero(st_params_.q_size);
+    tau_offset_ = VectorXd::Zero(st_params_.q_size);
+    tare_sum_ = VectorXd::Zero(st_params_.q_size);
+}
+
+const Vector3d& TipForceEstimator::update(const srl::State& state, const DynamicParams& dyn, const VectorXd& p){
+    assert(p.size() == st_params_.p_size);
+    assert(0 <= segment_ && segment_ < dyn.J.size());
+
+    tau_res_.noalias() = dyn.K * state.q;
+    tau_res_.noalias() += dyn.D * state.dq;
+    tau_res_.noalias() -= dyn.A * p * 100; //convert from mbar
+    tau_res_ += dyn.c + dyn.g;
+    if (inertial_)
+        tau_res_.noalias() += dyn.B * state.ddq;
+
+    if (tare_remaining_ > 0){
+        tare_sum_ += tau_res_;
+        if (--tare_remaining_ == 0){
+            tau_offset_ = tare_sum_ / tare_samples_;
+            f_.setZero();
+            fmt::print("TipForceEstimator: tared over {} samples.\n", tare_samples_);
+        }
+        return f_;
+    }
+    tau_res_ -= tau_offset_;
+
+    const MatrixXd& J = dyn.J[segment_];
+    Matrix3d JJt = J * J.transpose();
+    JJt.diagonal().array() += regularization_;
+    Vector3d rhs = J * tau_res_ + regularization_ * f_;
+    f_ = JJt.llt().solve(rhs);
+    return f_;
+}
+
+void TipForceEstimator::tare(int samples){
+    assert(samples > 0);
+    tare_sum_.setZero();
+    tare_samples_ = samples;
+    tare_remaining_ = samples;
+}
+
+void TipForceEstimator::reset(){
+    f_.setZero();
+    tau_offset_.setZero();
+    tare_remaining_ = 0;
+}
@@ -0,0 +1,88 @@
+#include "3d-soft-trunk/TrajectoryGenerator.h"
+
+void TrajectoryGenerator::add_waypoint(const Vector3d& x, double duration, bool replace_pending){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (replace_pending)
+        queue_.clear();
+    queue_.push_back({x, duration});
+}
+
+void TrajectoryGenerator::clear(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    queue_.clear();
+    running_ = false;
+}
+
+bool TrajectoryGenerator::active(){
+    std::lock_guard<std::mutex> lock(mtx_);
+    return running_ || !queue_.empty();
+}
+
+double TrajectoryGenerator::duration(double distance) const {
+    double T = std::max(min_duration_, 1.875*distance/max_velocity_);
+    T = std::max(T, sqrt(5.7735*distance/max_acceleration_));
+    return std::max(T, cbrt(60*distance/max_jerk_));
+}
+
+void TrajectoryGenerator::start_segment(const Vector3d& x0, const Vector3d& dx0, const Vector3d& ddx0){
+    const Waypoint wp = queue_.front();
+    queue_.pop_front();
+    const Vector3d x1 = wp.x;
+    const double T = (wp.duration > 0) ? wp.duration : duration((x1 - x0).norm());
+
+    // blend through the waypoint if the next one is known, per axis with the average of the adjacent segment velocities unless the direction reverses
+    Vector3d dx1 = Vector3d::Zero();
+    if (!queue_.empty()){
+        const Waypoint& next = queue_.front();
+        double T_next = (next.duration > 0) ? next.duration : duration((next.x - x1).norm());
+        Vector3d v_in = (x1 - x0)/T;
+        Vector3d v_out = (next.x - x1)/T_next;
+        for (int i = 0; i < 3; i++)
+            if (v_in(i)*v_out(i) > 0)
+                dx1(i) = 0.5*(v_in(i) + v_out(i));
+    }
+
+    // quintic with the given boundary conditions, zero acceleration at the end
+    const Vector3d d = x1 - x0;
+    coeffs_.col(0) = x0;
+    coeffs_.col(1) = dx0;
+    coeffs_.col(2) = 0.5*ddx0;
+    coeffs_.col(3) = (20*d - (8*dx1 + 12*dx0)*T - 3*ddx0*T*T) / (2*pow(T,3));
+    coeffs_.col(4) = (-30*d + (14*dx1 + 16*dx0)*T + 3*ddx0*T*T) / (2*pow(T,4));
+    coeffs_.col(5) = (12*d - 6*(dx1 + dx0)*T - ddx0*T*T) / (2*pow(T,5));
+    t_ = 0;
+    T_ = T;
+    running_ = true;
+}
+
+void TrajectoryGenerator::evaluate(double t, Vector3d& x, Vector3d& dx, Vector3d& ddx) const {
+    x = coeffs_*Matrix<double, 6, 1>(1, t, t*t, pow(t,3), pow(t,4), pow(t,5));
+    dx = coeffs_.rightCols<5>()*Matrix<double, 5, 1>(1, 2*t, 3*t*t, 4*pow(t,3), 5*pow(t,4));
+    ddx = coeffs_.rightCols<4>()*Matrix<double, 4, 1>(2, 6*t, 12*t*t, 20*pow(t,3));
+}
+
+bool TrajectoryGenerator::step(double dt, Vector3d& x, Vector3d& dx, Vector3d& ddx){
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_){
+        if (queue_.empty())
+            return false;
+        start_segment(x, Vector3d::Zero(), Vector3d::Zero());
+    } else {
+        t_ += dt;
+    }
+
+    // continue with the next segment if this one is finished, the remaining time carries over
+    while (t_ >= T_){
+        double t_over = t_ - T_;
+        evaluate(T_, x, dx, ddx);
+        if (queue_.empty()){
+            running_ = false;
+            return true;
+        }
+        start_segment(x, dx, ddx);
+        t_ = t_over;
+    }
+
+    evaluate(t_, x, dx, ddx);
+    return true;
+}
@@ -0,0 +1,102 @@
+#include "3d-soft-trunk/WholeBodyAvoidance.h"
+
+WholeBodyAvoidance::WholeBodyAvoidance(const SoftTrunkParameters& st_params, int points_per_section) : st_params_(st_params), points_per_section_(points_per_section), kinematics_(st_params){
+    assert(st_params_.is_finalized());
+    assert(points_per_section_ > 0);
+
+    // points along the sections and at the end of each connector. the arm tapers linearly from the top to the bottom diameter of each segment
+    std::vector<double> arc_lengths;
+    double segment_start = 0;
+    for (int i = 0; i < st_params_.num_segments; i++){
+        const int n = st_params_.sections_per_segment*points_per_section_;
+        for (int j = 0; j < n; j++){
+            double s = (j + 1.)/n;
+            arc_lengths.push_back(segment_start + s*st_params_.lengths[2*i]);
+            point_radii_.push_back(0.5*((1 - s)*st_params_.diameters[i] + s*st_params_.diameters[i+1]));
+        }
+        arc_lengths.push_back(kinematics_.segment_end(i));
+        point_radii_.push_back(0.5*st_params_.diameters[i+1]);
+        segment_start = kinematics_.segment_end(i);
+    }
+    kinematics_.set_points(arc_lengths);
+    points_.resize(arc_lengths.size());
+    forces_.resize(arc_lengths.size(), Vector3d::Zero());
+    set_obstacles({}, {});
+}
+
+long long int WholeBodyAvoidance::cell_key(long long int i, long long int j, long long int k) const {
+    const long long int mask = (1LL << 21) - 1;
+    return ((i & mask) << 42) | ((j & mask) << 21) | (k & mask);
+}
+
+long long int WholeBodyAvoidance::cell_key(const Vector3d& x) const {
+    return cell_key((long long int) floor(x(0)/cell_size_), (long long int) floor(x(1)/cell_size_), (long long int) floor(x(2)/cell_size_));
+}
+
+void WholeBodyAvoidance::set_obstacles(const std::vector<Vector3d>& centers, const std::vector<double>& radii){
+    assert(centers.size() == radii.size());
+    obstacle_centers_.resize(3, centers.size());
+    obstacle_radii_.resize(radii.size());
+    for (int i = 0; i < centers.size(); i++){
+        obstacle_centers_.col(i) = centers[i];
+        obstacle_radii_(i) = radii[i];
+    }
+
+    // a cell is as large as the longest range between a body point and an obstacle center, so only neighboring cells need to be checked
+    double max_radius = obstacle_radii_.size() ? obstacle_radii_.maxCoeff() : 0;
+    cell_size_ = cutoff_distance_ + max_radius + *std::max_element(point_radii_.begin(), point_radii_.end());
+    grid_.clear();
+    for (int i = 0; i < centers.size(); i++)
+        grid_[cell_key(centers[i])].push_back(i);
+}
+
+VectorXd WholeBodyAvoidance::torques(const Ref<const VectorXd>& q){
+    assert(q.size() == st_params_.q_size);
+    kinematics_.update(q);
+    for (int k = 0; k < points_.size(); k++)
+        points_[k] = kinematics_.position(k);
+    VectorXd tau = VectorXd::Zero(st_params_.q_size);
+    min_distance_ = std::numeric_limits<double>::infinity();
+
+    for (int k = 0; k < points_.size(); k++){
+        forces_[k].setZero();
+        if (grid_.empty())
+            continue;
+
+        // gather the obstacles of the neighboring cells
+        candidates_.clear();
+        const long long int ci = floor(points_[k](0)/cell_size_);
+        const long long int cj = floor(points_[k](1)/cell_size_);
+        const long long int ck = floor(points_[k](2)/cell_size_);
+        for (int di = -1; di <= 1; di++)
+            for (int dj = -1; dj <= 1; dj++)
+                for (int dk = -1; dk <= 1; dk++){
+                    auto cell = grid_.find(cell_key(ci+di, cj+dj, ck+dk));
+                    if (cell != grid_.end())
+                        candidates_.insert(candidates_.end(), cell->second.begin(), cell->second.end());
+                }
+        if (candidates_.empty())
+            continue;
+
+        candidate_centers_.resize(3, candidates_.size());
+        VectorXd candidate_radii(candidates_.size());
+        for (int c = 0; c < candidates_.size(); c++){
+            candidate_centers_.col(c) = obstacle_centers_.col(candidates_[c]);
+            candidate_radii(c) = obstacle_radii_(candidates_[c]);
+        }
+        candidate_centers_.colwise() -= points_[k]; // now the offsets from the point to the obstacles
+        VectorXd surface_distance = candidate_centers_.colwise().norm().transpose() - candidate_radii;
+        surface_distance.array() -= point_radii_[k];
+
+        for (int c = 0; c < candidates_.size(); c++){
+            double d = surface_distance(c);
+            if (d >= cutoff_distance_)
+                continue;
+            min_distance_ = std::min(min_distance_, d);
+            d = std::max(d, 1e-3); // in contact, limit the force
+            forces_[k] -= strength_*(1./d - 1./cutoff_distance_)*candidate_centers_.col(c).normalized();
+        }
+        tau.noalias() += kinematics_.jacobian(k).transpose()*forces_[k];
+    }
+    return tau;
+}
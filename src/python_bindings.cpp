@@ -1,5 +1,6 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
+#include <pybind11/numpy.h>
 #include <pybind11/stl.h>
 
 #include <3d-soft-trunk/StateEstimator.h>
@@ -8,36 +9,172 @@
 
 namespace py = pybind11;
 
+typedef Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> RowMajorMap;
+
+/** @brief getter which returns a numpy view onto an Eigen member (no copy), that stays valid as long as the owning object is alive */
+template <typename C, typename T>
+py::cpp_function view(T C::*member){
+    return py::cpp_function([member](C& c) -> T& {return c.*member;}, py::return_value_policy::reference_internal);
+}
+
+/** @brief setter which assigns (and possibly resizes) an Eigen member */
+template <typename C, typename T>
+std::function<void(C&, const T&)> assign(T C::*member){
+    return [member](C& c, const T& value){c.*member = value;};
+}
+
+/** @brief transforms as a list of 4x4 matrices (copied) */
+template <typename Transforms>
+std::vector<Matrix4d> to_matrices(const Transforms& transforms){
+    std::vector<Matrix4d> out(transforms.size());
+    for (int i = 0; i < transforms.size(); i++)
+        out[i] = transforms[i].matrix();
+    return out;
+}
+
 PYBIND11_MODULE(softtrunk_pybind_module, m){
-    /** @todo would be better if elements could be set like `state.q[0] = 0.1` in Python */
-    py::class_<srl::State>(m, "State", "individual elements in array can be read but not set, see example codes")
+    py::enum_<SensorType>(m, "SensorType")
+        .value("qualisys", SensorType::qualisys)
+        .value("bendlabs", SensorType::bendlabs)
+        .value("simulator", SensorType::simulator)
+        .value("simulated", SensorType::simulated);
+
+    py::class_<srl::State>(m, "State", "q, dq, ddq are numpy views onto the C++ state, so elements can be set in place like `state.q[0] = 0.1`")
         .def(py::init<>())
         .def("setSize", &srl::State::setSize)
-        .def_property("q", [](srl::State& s){return s.q;}, [](srl::State& s, const VectorXd& q){s.q=q;})
-        .def_property("dq", [](srl::State& s){return s.dq;}, [](srl::State& s, const VectorXd& dq){s.dq=dq;})
-        .def_property("ddq", [](srl::State& s){return s.ddq;}, [](srl::State& s, const VectorXd& ddq){s.ddq=ddq;});
+        .def_property("q", view(&srl::State::q), assign(&srl::State::q))
+        .def_property("dq", view(&srl::State::dq), assign(&srl::State::dq))
+        .def_property("ddq", view(&srl::State::ddq), assign(&srl::State::ddq))
+        .def_readwrite("timestamp", &srl::State::timestamp)
+        .def_property_readonly("tip_transforms", [](srl::State& s){return to_matrices(s.tip_transforms);})
+        .def_property_readonly("objects", [](srl::State& s){return to_matrices(s.objects);});
+
+    py::class_<DynamicParams>(m, "DynamicParams", "B ddq + c + g + K q + D dq = A p. Matrices are numpy views onto the C++ object, J is a (copied) list of the segment tip jacobians")
+        .def(py::init<>())
+        .def_property("A", view(&DynamicParams::A), assign(&DynamicParams::A))
+        .def_property("A_pseudo", view(&DynamicParams::A_pseudo), assign(&DynamicParams::A_pseudo))
+        .def_property("B", view(&DynamicParams::B), assign(&DynamicParams::B))
+        .def_property("c", view(&DynamicParams::c), assign(&DynamicParams::c))
+        .def_property("D", view(&DynamicParams::D), assign(&DynamicParams::D))
+        .def_property("g", view(&DynamicParams::g), assign(&DynamicParams::g))
+        .def_property("K", view(&DynamicParams::K), assign(&DynamicParams::K))
+        .def_property("S", view(&DynamicParams::S), assign(&DynamicParams::S))
+        .def_readwrite("J", &DynamicParams::J)
+        .def_readwrite("dJ", &DynamicParams::dJ)
+        .def_readwrite("x", &DynamicParams::x)
+        .def_readonly("kinematics_timestamp", &DynamicParams::kinematics_timestamp)
+        .def_readonly("dynamics_timestamp", &DynamicParams::dynamics_timestamp);
 
 
     py::class_<SoftTrunkParameters>(m, "SoftTrunkParameters")
         .def(py::init<>())
         .def("getBlankState", &SoftTrunkParameters::getBlankState)
         .def("finalize", &SoftTrunkParameters::finalize)
-        .def("load_yaml", &SoftTrunkParameters::load_yaml);
+        .def("load_yaml", &SoftTrunkParameters::load_yaml)
+        .def_readwrite("sensors", &SoftTrunkParameters::sensors)
+        .def_readonly("q_size", &SoftTrunkParameters::q_size)
+        .def_readonly("p_size", &SoftTrunkParameters::p_size);
 
 
     py::class_<StateEstimator>(m, "StateEstimator")
         .def(py::init<SoftTrunkParameters>())
-        .def("poll_sensors", &StateEstimator::poll_sensors);
+        .def("poll_sensors", &StateEstimator::poll_sensors, py::call_guard<py::gil_scoped_release>());
 
     py::class_<Model>(m, "Model")
         .def(py::init<SoftTrunkParameters>())
-        .def("update", &Model::update)
-        .def("pseudo2real", &Model::pseudo2real);
+        .def("update", &Model::update, py::arg("state"), py::arg("force") = false, py::call_guard<py::gil_scoped_release>(),
+            "update the dynamic parameters, returns false if the results of the last update were reused")
+        .def_property_readonly("updates_computed", [](const Model& mdl){ return mdl.updates_computed_.load(); })
+        .def_property_readonly("updates_skipped", [](const Model& mdl){ return mdl.updates_skipped_.load(); })
+        .def("pseudo2real", &Model::pseudo2real)
+        .def_property_readonly("dyn_", [](Model& mdl) -> DynamicParams& {return mdl.dyn_;}, py::return_value_policy::reference_internal)
+        .def("update_many", [](Model& mdl, const Eigen::Ref<const MatrixXd>& Q, py::object dQ_obj){
+            // update the model for each row of Q (and dQ), and return the results stacked along the first axis
+            const int n = Q.rows();
+            const int q_size = mdl.st_params_.q_size;
+            if (Q.cols() != q_size)
+                throw py::value_error(fmt::format("Q must have q_size = {} columns, got {}", q_size, Q.cols()));
+            MatrixXd dQ = MatrixXd::Zero(n, q_size);
+            if (!dQ_obj.is_none())
+                dQ = dQ_obj.cast<MatrixXd>();
+            if (dQ.rows() != n || dQ.cols() != q_size)
+                throw py::value_error(fmt::format("dQ must have the shape of Q ({}, {}), got ({}, {})", n, q_size, dQ.rows(), dQ.cols()));
+
+            py::array_t<double> B(std::vector<py::ssize_t>{n, q_size, q_size});
+            py::array_t<double> c(std::vector<py::ssize_t>{n, q_size});
+            py::array_t<double> g(std::vector<py::ssize_t>{n, q_size});
+            py::array_t<double> J(std::vector<py::ssize_t>{n, 3, q_size});
+            double* B_data = B.mutable_data();
+            double* c_data = c.mutable_data();
+            double* g_data = g.mutable_data();
+            double* J_data = J.mutable_data();
+            {
+                py::gil_scoped_release release;
+                srl::State state = mdl.st_params_.getBlankState();
+                const int tip = mdl.st_params_.num_segments - 1; // DynamicParams::J has one jacobian per segment
+                for (int i = 0; i < n; i++){
+                    state.q = Q.row(i).transpose();
+                    state.dq = dQ.row(i).transpose();
+                    mdl.update(state, true);
+                    RowMajorMap(B_data + i*q_size*q_size, q_size, q_size) = mdl.dyn_.B;
+                    RowMajorMap(c_data + i*q_size, 1, q_size) = mdl.dyn_.c.transpose();
+                    RowMajorMap(g_data + i*q_size, 1, q_size) = mdl.dyn_.g.transpose();
+                    RowMajorMap(J_data + i*3*q_size, 3, q_size) = mdl.dyn_.J[tip];
+                }
+            }
+            py::dict out;
+            out["B"] = B;
+            out["c"] = c;
+            out["g"] = g;
+            out["J"] = J;
+            return out;
+        }, py::arg("Q"), py::arg("dQ") = py::none(),
+        "update the model for each row of Q (and dQ, zero if not given). Returns a dict of stacked arrays B (n,q,q), c (n,q), g (n,q) and the tip jacobian J (n,3,q)");
+
+    py::class_<TrajectoryGenerator>(m, "TrajectoryGenerator", "limits of the trajectory generator of a controller")
+        .def_readwrite("max_velocity_", &TrajectoryGenerator::max_velocity_)
+        .def_readwrite("max_acceleration_", &TrajectoryGenerator::max_acceleration_)
+        .def_readwrite("max_jerk_", &TrajectoryGenerator::max_jerk_)
+        .def_readwrite("min_duration_", &TrajectoryGenerator::min_duration_);
 
     py::class_<ControllerPCC>(m, "ControllerPCC")
         .def(py::init<SoftTrunkParameters>())
         .def("set_ref", py::overload_cast<const srl::State&>(&ControllerPCC::set_ref))
         .def("set_ref", py::overload_cast<const Vector3d&, const Vector3d&, const Vector3d&>(&ControllerPCC::set_ref))
+        .def("set_ref_ik", &ControllerPCC::set_ref_ik, py::arg("x_ref"), py::arg("dx_ref") = Vector3d::Zero())
+        .def("add_waypoint", &ControllerPCC::add_waypoint, py::arg("x"), py::arg("duration") = 0., py::arg("replace_pending") = false,
+            "queue a task space waypoint, the controller follows a smooth trajectory through the queued waypoints. replace_pending drops the waypoints which are still queued")
+        .def("clear_waypoints", &ControllerPCC::clear_waypoints)
         .def("toggle_log", &ControllerPCC::toggle_log)
-        .def("simulate", &ControllerPCC::simulate);
+        .def("simulate", &ControllerPCC::simulate, py::call_guard<py::gil_scoped_release>())
+        .def("simulate_many", [](ControllerPCC& ctrl, const Eigen::Ref<const MatrixXd>& P){
+            // simulate one step of dt_ for each row of P, and return the trajectory
+            const int n = P.rows();
+            const int q_size = ctrl.st_params_.q_size;
+            if (P.cols() != ctrl.st_params_.p_size)
+                throw py::value_error(fmt::format("P must have p_size = {} columns, got {}", ctrl.st_params_.p_size, P.cols()));
+            MatrixXd Q(n, q_size);
+            MatrixXd dQ(n, q_size);
+            int steps = 0;
+            {
+                py::gil_scoped_release release;
+                for (; steps < n; steps++){
+                    if (!ctrl.simulate(P.row(steps).transpose()))
+                        break;  // the simulation diverged, only the valid steps are returned
+                    Q.row(steps) = ctrl.state_.q.transpose();
+                    dQ.row(steps) = ctrl.state_.dq.transpose();
+                }
+            }
+            return py::make_tuple(MatrixXd(Q.topRows(steps)), MatrixXd(dQ.topRows(steps)));
+        }, py::arg("P"),
+        "simulate one step of dt_ for each row of pressures P (n, p_size), in mbar. Returns q and dq after each step as arrays (n, q). Stops early if the simulation diverges")
+        .def_readwrite("dt_", &ControllerPCC::dt_)
+        .def_readonly("trajectory_", &ControllerPCC::trajectory_)
+        .def_property_readonly("model_updates_computed", &ControllerPCC::model_updates_computed)
+        .def_property_readonly("model_updates_skipped", &ControllerPCC::model_updates_skipped)
+        .def("tip_force", &ControllerPCC::tip_force, "external force on the tip estimated from the model residual, in N")
+        .def("tare_tip_force", &ControllerPCC::tare_tip_force, py::arg("samples") = 50, "take the current model residual as the offset of no external force")
+        .def_property("state_", [](ControllerPCC& ctrl) -> srl::State& {return ctrl.state_;}, [](ControllerPCC& ctrl, const srl::State& state){ctrl.state_ = state;}, py::return_value_policy::reference_internal)
+        .def_property_readonly("dyn_", [](ControllerPCC& ctrl) -> DynamicParams& {return ctrl.dyn_;}, py::return_value_policy::reference_internal)
+        .def_property_readonly("p_", view(&ControllerPCC::p_));
 }